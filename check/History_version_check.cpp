@@ -0,0 +1,82 @@
+// Checks that history files of version 1 still open:
+//
+//     History-version-check history_file
+//
+// The history file has to be of the current version with double values. A copy with a version 1
+// header is written next to it and both are read back, their frames have to be the same.
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "Frame_sink.hpp"
+
+namespace
+{
+    void write_version_1_copy(const std::string& file_path, const std::string& copy_path)
+    {
+        std::ifstream file(file_path, std::ios::binary);
+        std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (!file || bytes.size() < sizeof(HistoryHeader))
+            throw std::ios_base::failure("Unable to read the file: " + file_path);
+
+        // Version 1 headers end before value_size.
+        HistoryHeader header;
+        std::memcpy(reinterpret_cast<char*>(&header), bytes.data(), sizeof(HistoryHeader));
+        if (header.value_size != sizeof(double))
+            throw std::runtime_error("Version 1 history files have double values only.");
+        header.version = 1;
+        header.header_size = offsetof(HistoryHeader, value_size);
+
+        std::ofstream copy(copy_path, std::ios::binary | std::ios::trunc);
+        copy.write(reinterpret_cast<const char*>(&header), header.header_size);
+        copy.write(bytes.data() + sizeof(HistoryHeader), bytes.size() - sizeof(HistoryHeader));
+        if (!copy)
+            throw std::ios_base::failure("Unable to write the file: " + copy_path);
+    }
+
+    bool have_same_frames(FileFrameSink& a, FileFrameSink& b)
+    {
+        if (a.get_frame_count() != b.get_frame_count()
+            || a.get_header().values_per_frame != b.get_header().values_per_frame)
+            return false;
+        int values = a.get_header().values_per_frame;
+        for (int number = 0; number < a.get_frame_count(); number++) {
+            if (a.get_frame_time(number) != b.get_frame_time(number))
+                return false;
+            for (int index = 0; index < values; index++) {
+                if (a.get_value(number, index) != b.get_value(number, index))
+                    return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " history_file" << std::endl;
+        return 2;
+    }
+    try {
+        std::string file_path = argv[1];
+        std::string copy_path = file_path + ".v1";
+        write_version_1_copy(file_path, copy_path);
+        FileFrameSink history(file_path);
+        FileFrameSink copy(copy_path);
+        if (history.get_frame_count() == 0 || !have_same_frames(history, copy)) {
+            std::cerr << copy_path << ": The frames differ from " << file_path << "." << std::endl;
+            return 1;
+        }
+        std::cout << copy_path << ": " << copy.get_frame_count() << " frames of version 1 read back." << std::endl;
+    }
+    catch (const std::exception& exception) {
+        std::cerr << exception.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,54 @@
+#!/bin/sh
+# Checks invariants of the headless runs which the job switches must not change:
+#
+#     check.sh headless_executable history_version_check_executable
+#
+# The fused and the staged RK4 kernel, time batching and the sweep over the grid, and mirrored
+# and integrated pendulums write the same history files bit for bit, the tiles of level 0 put
+# together the image of a full run and a history file with a version 1 header still opens.
+set -u
+
+headless=$1
+version_check=$2
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+failed=0
+check() {
+    if cmp -s "$2" "$3"; then
+        echo "ok: $1"
+    else
+        echo "FAILED: $1"
+        failed=1
+    fi
+}
+run() {
+    "$headless" size_x=64 size_y=48 max_time=2 time_step=0.1 integration_step=0.01 "$@" > /dev/null || failed=1
+}
+
+run method=rk4 fused_kernel=true history_file="$work/fused.dphist"
+run method=rk4 fused_kernel=false history_file="$work/staged.dphist"
+check "fused and staged RK4 kernels" "$work/fused.dphist" "$work/staged.dphist"
+
+# One thread and no mirrored pendulums, otherwise the grid is always split into blocks.
+run method=rk4 threads=1 point_symmetry=false time_batching=true history_file="$work/batched.dphist"
+run method=rk4 threads=1 point_symmetry=false time_batching=false history_file="$work/swept.dphist"
+check "time batching and sweeps" "$work/batched.dphist" "$work/swept.dphist"
+
+# A grid of odd size has a centre row and column, whose mirrors start from zeros.
+run size_x=61 size_y=47 point_symmetry=true history_file="$work/mirrored.dphist"
+run size_x=61 size_y=47 point_symmetry=false history_file="$work/integrated.dphist"
+check "mirrored and integrated pendulums" "$work/mirrored.dphist" "$work/integrated.dphist"
+
+run image_folder="$work/full"
+run image_folder="$work/tiled" tile_cache="$work/tiles" tile_size=32
+check "level 0 tiles and a full run" "$work/full/job_00020.png" "$work/tiled/job_00020.png"
+
+if "$version_check" "$work/fused.dphist" > /dev/null; then
+    echo "ok: version 1 history files"
+else
+    echo "FAILED: version 1 history files"
+    failed=1
+fi
+
+exit $failed
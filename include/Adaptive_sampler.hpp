@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Pendulum_system.hpp"
+#include "Runge-Kutta.hpp"
+
+#include <memory>
+#include <vector>
+
+// Computes the map of a pendulum system at one time without integrating every pendulum. A coarse
+// grid is integrated first, and only the cells whose corners disagree in the rendered quantity
+// (the quadrants of the angles, or the flip time in the first flip time mode) are subdivided.
+// The interior of a uniform cell is filled from its corners. Features which fit between the
+// corners of a coarse cell can be missed.
+//
+// The system has to be at its initial state. Afterwards its state and flip times hold the map,
+// ready for render_quadrant_image or render_flip_time_image.
+class AdaptiveSampler
+{
+    private:
+        struct Cell
+        {
+            int x0;
+            int x1;
+            int y0;
+            int y1;
+        };
+
+        std::shared_ptr<PendulumSystem> system;
+        double integration_step;
+        double time_step;
+        int coarse_cell_size = 16;
+        double tolerance = 0.05;
+        int thread_count = 0;
+        IntegrationMethod method = IntegrationMethod::RK4;
+        double absolute_tolerance = 1e-8;
+        double relative_tolerance = 1e-8;
+
+        int size_x;
+        int size_y;
+        std::vector<bool> integrated;
+        int integrated_count = 0;
+
+        void integrate(std::vector<int>& pendulums, double time_max);
+        bool agree(int a, int b, double time_max);
+        void fill(const Cell& cell, double time_max);
+
+    public:
+        AdaptiveSampler(std::shared_ptr<PendulumSystem> system, double integration_step, double time_step);
+
+        void set_coarse_cell_size(int coarse_cell_size);
+        // Largest difference of log(1 + flip time) between the corners of a uniform cell; the
+        // quadrants always have to be equal.
+        void set_tolerance(double tolerance);
+        // 0 uses all hardware threads.
+        void set_thread_count(int thread_count);
+        void set_method(IntegrationMethod method, double absolute_tolerance, double relative_tolerance);
+
+        void sample(double time_max);
+        int get_integrated_count(){
+            return integrated_count;
+        }
+};
@@ -0,0 +1,189 @@
+#pragma once
+
+#include "Mapped_file.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+// Header of a history file. It is followed by fixed-size frame records, each holding the time of
+// the frame as a double and values_per_frame values of the state, doubles or floats as given by
+// value_size, so any frame is found in constant time. Version 1 files end the header before
+// value_size and always store doubles.
+struct HistoryHeader
+{
+    char magic[8] = {'D', 'P', 'H', 'I', 'S', 'T', '\0', '\0'};
+    std::uint32_t version = 2;
+    std::uint32_t header_size = 128;
+    std::int32_t size_x = 0;
+    std::int32_t size_y = 0;
+    std::array<double, 4> bounds = {};
+    double mass_1 = 0;
+    double mass_2 = 0;
+    double length_1 = 0;
+    double length_2 = 0;
+    double time_step = 0;
+    double integration_step = 0;
+    std::uint64_t values_per_frame = 0;
+    std::uint64_t frame_count = 0;
+    std::uint32_t value_size = sizeof(double);
+    std::uint32_t reserved = 0;
+};
+static_assert(sizeof(HistoryHeader) == 128, "The history header has to have the same layout on all platforms.");
+
+// Destination of the frames produced by the solver. Frames are recorded in order with numbers
+// 0, 1, 2, ...; depending on the sink only some of them can be read back.
+//
+// A frame is counted by get_frame_count() only once it is completely stored, so one thread may
+// read the counted frames while another one records new frames, provided the recording thread
+// reserved room for all its frames in advance.
+class FrameSink
+{
+    protected:
+        std::vector<double> frame_times;
+        std::atomic<int> frame_count{0};
+
+    public:
+        virtual ~FrameSink() = default;
+
+        virtual void reserve(int frame_count){
+            frame_times.reserve(frame_count);
+        }
+        virtual void record(int number, double time, const std::vector<double>& state) = 0;
+        virtual bool has_frame(int number) = 0;
+        // Whether the stored frames hold the complete state in full precision.
+        virtual bool is_lossless(){
+            return true;
+        }
+        // Value with the given index of the state of a stored frame.
+        virtual double get_value(int number, int index) = 0;
+
+        int get_frame_count(){
+            return frame_count.load(std::memory_order_acquire);
+        }
+        double get_frame_time(int number);
+
+    protected:
+        void register_frame(int number, double time);
+        void publish_frame(int number){
+            frame_count.store(number + 1, std::memory_order_release);
+        }
+        void check_frame(int number);
+};
+
+// Keeps every frame in memory.
+class InMemoryFrameSink : public FrameSink
+{
+    private:
+        std::vector<std::vector<double>> frames;
+
+    public:
+        void reserve(int frame_count);
+        void record(int number, double time, const std::vector<double>& state);
+        bool has_frame(int number);
+        double get_value(int number, int index);
+};
+
+// Keeps the last capacity frames in memory, older frames are overwritten.
+class RingBufferFrameSink : public FrameSink
+{
+    private:
+        int capacity;
+        std::vector<std::vector<double>> frames;
+
+    public:
+        RingBufferFrameSink(int capacity);
+
+        void record(int number, double time, const std::vector<double>& state);
+        bool has_frame(int number);
+        double get_value(int number, int index);
+};
+
+// Stores the frames in a history file and reads them back through a memory mapping, so opening a
+// recorded run does not load anything and any frame can be accessed in constant time.
+class FileFrameSink : public FrameSink
+{
+    private:
+        std::string file_path;
+        std::fstream file;
+        HistoryHeader header;
+        std::unique_ptr<MappedFile> mapping;
+        // Readers share the mapping; remapping it to take in appended frames replaces it, so it
+        // waits until no reader is left.
+        std::shared_mutex mapping_mutex;
+
+        double read_value(std::uint64_t offset);
+        std::uint64_t get_record_offset(int number){
+            return header.header_size + static_cast<std::uint64_t>(number) * (sizeof(double) + header.values_per_frame * header.value_size);
+        }
+        void write_header();
+
+    public:
+        // Creates a new history file, the number of values per frame is taken from the first frame.
+        FileFrameSink(std::string file_path, const HistoryHeader& header);
+        // Opens an existing history file, further frames are appended to it.
+        FileFrameSink(std::string file_path);
+
+        const HistoryHeader& get_header(){
+            return header;
+        }
+
+        void record(int number, double time, const std::vector<double>& state);
+        bool has_frame(int number);
+        bool is_lossless(){
+            return header.value_size == sizeof(double);
+        }
+        double get_value(int number, int index);
+};
+
+// Keeps frames of a PendulumSystem quantised to 16 bits per value. The angles are normalised to
+// [0, 2*pi) and stored as fixed point with a resolution of 2*pi/65536; the angular velocities
+// are optional and stored as half precision floats. This takes 4 (angles only 8) times less
+// memory than full frames, the live state of the integrator stays in double precision.
+class QuantizedFrameSink : public FrameSink
+{
+    private:
+        bool store_velocities;
+        int pendulum_count = 0;
+        std::vector<std::vector<std::uint16_t>> frames;
+
+    public:
+        QuantizedFrameSink(bool store_velocities);
+
+        void reserve(int frame_count);
+        bool has_velocities(){
+            return store_velocities;
+        }
+        bool is_lossless(){
+            return false;
+        }
+
+        void record(int number, double time, const std::vector<double>& state);
+        bool has_frame(int number);
+        double get_value(int number, int index);
+
+        static std::uint16_t quantize_angle(double angle);
+        static double dequantize_angle(std::uint16_t value);
+        static std::uint16_t to_half(double value);
+        static double from_half(std::uint16_t value);
+};
+
+// Hands every frame to a callback (e.g. to render it) and does not keep it.
+class DiscardFrameSink : public FrameSink
+{
+    private:
+        std::function<void(int number, double time, const std::vector<double>& state)> callback;
+
+    public:
+        DiscardFrameSink(std::function<void(int number, double time, const std::vector<double>& state)> callback);
+
+        void record(int number, double time, const std::vector<double>& state);
+        bool has_frame(int number);
+        double get_value(int number, int index);
+};
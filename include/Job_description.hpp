@@ -0,0 +1,76 @@
+#pragma once
+
+#include "Pendulum_image.hpp"
+#include "Runge-Kutta.hpp"
+
+#include <array>
+#include <optional>
+#include <string>
+
+// Settings of a run without the GUI. Job files hold one "key = value" pair per line, lines
+// starting with # are comments; the keys are the member names, bounds takes four numbers.
+struct JobDescription
+{
+    std::string name = "job";
+    int size_x = 256;
+    int size_y = 256;
+    std::array<double, 4> bounds = {-PI, PI, -PI, PI};
+    double mass_1 = 1.0;
+    double mass_2 = 1.0;
+    double length_1 = 1.0;
+    double length_2 = 1.0;
+    double integration_step = 0.01;
+    double time_step = 0.1;
+    double max_time = 0.2;
+    // method is rk4 or dormand_prince; the tolerances only apply to the latter.
+    IntegrationMethod method = IntegrationMethod::RK4;
+    double absolute_tolerance = 1e-8;
+    double relative_tolerance = 1e-8;
+    // precision is double, mixed or float, see Precision; float needs the fused RK4 kernel with
+    // time batching. The accuracy report compares the last
+    // map with the one of the same run in double precision, which is integrated as well; jobs
+    // with adaptive sampling or a tile cache have no report.
+    Precision precision = Precision::Double;
+    bool accuracy_report = false;
+    // RK4 advances blocks of pendulums through whole time steps in registers; the frames are
+    // the same without it.
+    bool fused_kernel = true;
+    // RK4 takes blocks of pendulums through all substeps of a time step while they are in the
+    // cache instead of sweeping the grid once per substep; the frames are the same.
+    bool time_batching = true;
+    // Retire pendulums after their first flip and colour the images by the flip time.
+    bool flip_time_mode = false;
+    // Only the map at max_time is computed, refining a grid of coarse_cell_size pixels where its
+    // corners disagree by more than refinement_tolerance; see AdaptiveSampler.
+    bool adaptive_sampling = false;
+    int coarse_cell_size = 16;
+    double refinement_tolerance = 0.05;
+    // Integrate only one pendulum of each pair with opposite initial states, on unless it is set.
+    // Adaptive sampling never mirrors and rejects it when it is set to true.
+    std::optional<bool> point_symmetry;
+    // 0 uses all hardware threads.
+    int threads = 0;
+    // Directory of a tile cache shared with the GUI and other jobs, with its size in megabytes.
+    // The last image is then put together from cached tiles of tile_size pixels, only missing
+    // ones are integrated; the job can have no other output.
+    std::string tile_cache;
+    int tile_cache_size = 512;
+    int tile_size = 256;
+
+    // Outputs, empty for none: the binary history of all frames, PNG images of every
+    // image_every-th frame (0 for the last frame only) and, in the first flip time mode, a text
+    // file with the flip times, one row of the grid per line, -1 where no flip happened and inf
+    // where the pendulum cannot flip.
+    std::string history_file;
+    std::string flip_time_file;
+    std::string image_folder;
+    int image_every = 0;
+};
+
+void set_job_value(JobDescription& job, const std::string& key, const std::string& value);
+// Sets the values given by a "key = value" line, comments and empty lines are ignored.
+void read_job_line(JobDescription& job, const std::string& line);
+JobDescription read_job_file(const std::string& file_path);
+// Throws when a value is out of its range, e.g. a step or a mass which is not positive, or the
+// values do not fit together.
+void validate_job(const JobDescription& job);
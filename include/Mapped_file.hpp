@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file.
+class MappedFile
+{
+    private:
+        std::string file_path;
+        const char* address = nullptr;
+        std::size_t length = 0;
+#ifdef _WIN32
+        void* file_handle = nullptr;
+        void* mapping_handle = nullptr;
+#else
+        int descriptor = -1;
+#endif
+
+        void unmap();
+
+    public:
+        MappedFile(std::string file_path);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        // Maps the file again with its current size, e.g. after data was appended to it.
+        void remap();
+
+        const char* data(){
+            return address;
+        }
+        std::size_t size(){
+            return length;
+        }
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Pendulum_system.hpp"
+
+#include <vector>
+
+constexpr double PI = 3.141592653589793;
+
+// Frame rendered for display, RGB with the top row first.
+struct DisplayFrame
+{
+    int number = 0;
+    double time = 0;
+    std::vector<unsigned char> pixels;
+};
+
+double normalize_angle(double angle);
+
+// Colours every pendulum by the quadrants of its two angles: yellow for both angles in [0, pi],
+// red for phi_2 only above pi, blue for phi_1 only above pi and green for both above pi.
+void render_quadrant_image(PendulumSystem& system, int number, std::vector<unsigned char>& pixels);
+void render_quadrant_image(PendulumSystem& system, const std::vector<double>& state, std::vector<unsigned char>& pixels);
+
+// Colours every pendulum which flipped by the given time by its flip time on a logarithmic scale,
+// from white for early flips over orange and purple to dark blue for flips close to the time;
+// pendulums which have not flipped yet are black.
+void render_flip_time_image(PendulumSystem& system, double time, std::vector<unsigned char>& pixels);
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <string>
+
+struct PendulumParameters
+{
+    double mass_1;
+    double mass_2;
+    double length_1;
+    double length_2;
+    double g;
+};
+
+// Equations of motion the kernels are specialised for at compile time. With equal arms, i.e.
+// mass_1 == mass_2 and length_1 == length_2, the mass matrix has constant entries and the
+// accelerations take a single division instead of five.
+enum class PendulumForm
+{
+    General,
+    EqualArms
+};
+
+PendulumForm get_pendulum_form(const PendulumParameters& parameters);
+
+// All kernels read a structure-of-arrays state: value v of pendulum n is state[v*stride + n]
+// for v = phi_1, phi_2, der_phi_1, der_phi_2. The right-hand side is written in the same layout.
+using PendulumRhsKernel = void (*)(const PendulumParameters& parameters,
+                                   const double* state,
+                                   double* right_hand_side,
+                                   int stride,
+                                   int count);
+
+// Advances count pendulums of a state in the same layout through the given number of classic RK4
+// substeps, keeping all stages in registers. The result is bitwise equal to RK4 on the
+// right-hand side kernel of the same instruction set and precision, apart from the float
+// precision, whose substeps are not taken in double.
+using PendulumRk4Kernel = void (*)(const PendulumParameters& parameters,
+                                   double* state,
+                                   int stride,
+                                   int count,
+                                   double step,
+                                   int substeps);
+
+enum class InstructionSet
+{
+    Scalar,
+    SSE2,
+    AVX2,
+    AVX512
+};
+
+// Double computes everything in double precision. Mixed keeps the state and the RK4 stages in
+// double but evaluates the accelerations in float. Float also takes the RK4 substeps in float,
+// with twice the lanes per register, and only rounds back to double when a block is stored; the
+// right-hand side kernel alone is the one of the mixed mode.
+enum class Precision
+{
+    Double,
+    Mixed,
+    Float
+};
+
+// Maximal allowed difference between a vectorised kernel and the scalar one, in units in the
+// last place of max(|scalar result|, g + der_phi_1^2 + der_phi_2^2), i.e. relative to the size
+// of the terms that cancel in the accelerations. The vectorised sin/cos are within 2 ulp of
+// libm on |x| < 2^20; measured differences of the whole right-hand side stay below 10 ulp.
+constexpr double rhs_kernel_ulp_bound = 16.0;
+
+// Instantiated for both forms in the file of their instruction set.
+template <PendulumForm form>
+void pendulum_rhs_scalar(const PendulumParameters& parameters, const double* state, double* right_hand_side, int stride, int count);
+template <PendulumForm form>
+void pendulum_rhs_sse2(const PendulumParameters& parameters, const double* state, double* right_hand_side, int stride, int count);
+template <PendulumForm form>
+void pendulum_rhs_avx2(const PendulumParameters& parameters, const double* state, double* right_hand_side, int stride, int count);
+template <PendulumForm form>
+void pendulum_rhs_avx512(const PendulumParameters& parameters, const double* state, double* right_hand_side, int stride, int count);
+
+template <PendulumForm form>
+void pendulum_rk4_scalar(const PendulumParameters& parameters, double* state, int stride, int count, double step, int substeps);
+template <PendulumForm form>
+void pendulum_rk4_sse2(const PendulumParameters& parameters, double* state, int stride, int count, double step, int substeps);
+template <PendulumForm form>
+void pendulum_rk4_avx2(const PendulumParameters& parameters, double* state, int stride, int count, double step, int substeps);
+template <PendulumForm form>
+void pendulum_rk4_avx512(const PendulumParameters& parameters, double* state, int stride, int count, double step, int substeps);
+
+template <PendulumForm form>
+void pendulum_rhs_float_scalar(const PendulumParameters& parameters, const double* state, double* right_hand_side, int stride, int count);
+template <PendulumForm form>
+void pendulum_rhs_float_sse2(const PendulumParameters& parameters, const double* state, double* right_hand_side, int stride, int count);
+template <PendulumForm form>
+void pendulum_rhs_float_avx2(const PendulumParameters& parameters, const double* state, double* right_hand_side, int stride, int count);
+template <PendulumForm form>
+void pendulum_rhs_float_avx512(const PendulumParameters& parameters, const double* state, double* right_hand_side, int stride, int count);
+
+template <PendulumForm form>
+void pendulum_rk4_mixed_scalar(const PendulumParameters& parameters, double* state, int stride, int count, double step, int substeps);
+template <PendulumForm form>
+void pendulum_rk4_mixed_sse2(const PendulumParameters& parameters, double* state, int stride, int count, double step, int substeps);
+template <PendulumForm form>
+void pendulum_rk4_mixed_avx2(const PendulumParameters& parameters, double* state, int stride, int count, double step, int substeps);
+template <PendulumForm form>
+void pendulum_rk4_mixed_avx512(const PendulumParameters& parameters, double* state, int stride, int count, double step, int substeps);
+
+template <PendulumForm form>
+void pendulum_rk4_float_scalar(const PendulumParameters& parameters, double* state, int stride, int count, double step, int substeps);
+template <PendulumForm form>
+void pendulum_rk4_float_sse2(const PendulumParameters& parameters, double* state, int stride, int count, double step, int substeps);
+template <PendulumForm form>
+void pendulum_rk4_float_avx2(const PendulumParameters& parameters, double* state, int stride, int count, double step, int substeps);
+template <PendulumForm form>
+void pendulum_rk4_float_avx512(const PendulumParameters& parameters, double* state, int stride, int count, double step, int substeps);
+
+InstructionSet detect_instruction_set();
+InstructionSet get_default_instruction_set();
+std::string get_instruction_set_name(InstructionSet instruction_set);
+std::string get_precision_name(Precision precision);
+// The kernels of the given form, General when omitted; get_pendulum_form picks the fastest one
+// for a set of parameters.
+PendulumRhsKernel get_rhs_kernel(InstructionSet instruction_set, Precision precision = Precision::Double,
+                                 PendulumForm form = PendulumForm::General);
+PendulumRk4Kernel get_rk4_kernel(InstructionSet instruction_set, Precision precision = Precision::Double,
+                                 PendulumForm form = PendulumForm::General);
+double measure_rhs_kernel_ulp_error(InstructionSet instruction_set, int samples);
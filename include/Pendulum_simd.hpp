@@ -0,0 +1,413 @@
+#pragma once
+
+// Vectorised double pendulum right-hand side. This header is only included by the
+// Pendulum_kernels_*.cpp files, each of which instantiates it for its own file-local vector
+// types V compiled with the matching instruction set flags. V provides the lane type value, the
+// register type reg, the comparison result type mask, the lane count width and the operations
+// used below. Vectors of floats also name the vector of doubles they are converted from as
+// double_vector, with narrow and widen converting two of its registers to one of theirs and back.
+//
+// Every operation is an exactly rounded add, sub, mul, div or floor (no fused multiply-add),
+// so all instruction sets produce bitwise identical results.
+
+#include "Pendulum_kernels.hpp"
+
+#include <type_traits>
+
+template <class V>
+constexpr bool simd_is_float = std::is_same<typename V::value, float>::value;
+
+// Loads V::width doubles into the lanes of V, rounded for a vector of floats.
+template <class V>
+inline typename V::reg simd_load(const double* address)
+{
+    if constexpr (simd_is_float<V>) {
+        using D = typename V::double_vector;
+        return V::narrow(D::load(address), D::load(address + D::width));
+    }
+    else {
+        return V::load(address);
+    }
+}
+
+template <class V>
+inline void simd_store(double* address, typename V::reg value)
+{
+    if constexpr (simd_is_float<V>) {
+        using D = typename V::double_vector;
+        typename D::reg low, high;
+        V::widen(value, low, high);
+        D::store(address, low);
+        D::store(address + D::width, high);
+    }
+    else {
+        V::store(address, value);
+    }
+}
+
+// Cody-Waite reduction by pi/4 followed by the Cephes minimax polynomials of the lane type.
+template <class V>
+inline void simd_sincos(typename V::reg x, typename V::reg& sin_x, typename V::reg& cos_x)
+{
+    using reg = typename V::reg;
+    using mask = typename V::mask;
+    constexpr bool single = simd_is_float<V>;
+
+    const reg zero = V::set1(0.0);
+    const reg one = V::set1(1.0);
+    const reg two = V::set1(2.0);
+    const reg four = V::set1(4.0);
+    const reg eight = V::set1(8.0);
+
+    mask negative = V::less(x, zero);
+    reg abs_x = V::select(negative, V::sub(zero, x), x);
+
+    // Octant j, rounded up to an even number so that z lies in [-pi/4, pi/4].
+    reg y = V::floor(V::mul(abs_x, V::set1(1.27323954473516268615)));
+    reg odd = V::sub(y, V::mul(two, V::floor(V::div(y, two))));
+    y = V::add(y, odd);
+    reg j = V::sub(y, V::mul(eight, V::floor(V::div(y, eight))));
+
+    reg z = V::sub(abs_x, V::mul(y, V::set1(single ? 7.8515625e-1 : 7.85398125648498535156e-1)));
+    z = V::sub(z, V::mul(y, V::set1(single ? 2.4187564849853515625e-4 : 3.77489470793079817668e-8)));
+    z = V::sub(z, V::mul(y, V::set1(single ? 3.77489497744594108e-8 : 2.69515142907905952645e-15)));
+    reg zz = V::mul(z, z);
+
+    reg sin_poly, cos_poly;
+    if constexpr (single) {
+        sin_poly = V::set1(-1.9515295891e-4);
+        sin_poly = V::add(V::mul(sin_poly, zz), V::set1(8.3321608736e-3));
+        sin_poly = V::add(V::mul(sin_poly, zz), V::set1(-1.6666654611e-1));
+
+        cos_poly = V::set1(2.443315711809948e-5);
+        cos_poly = V::add(V::mul(cos_poly, zz), V::set1(-1.388731625493765e-3));
+        cos_poly = V::add(V::mul(cos_poly, zz), V::set1(4.166664568298827e-2));
+    }
+    else {
+        sin_poly = V::set1(1.58962301576546568060e-10);
+        sin_poly = V::add(V::mul(sin_poly, zz), V::set1(-2.50507477628578072866e-8));
+        sin_poly = V::add(V::mul(sin_poly, zz), V::set1(2.75573136213857245213e-6));
+        sin_poly = V::add(V::mul(sin_poly, zz), V::set1(-1.98412698295895385996e-4));
+        sin_poly = V::add(V::mul(sin_poly, zz), V::set1(8.33333333332211858878e-3));
+        sin_poly = V::add(V::mul(sin_poly, zz), V::set1(-1.66666666666666307295e-1));
+
+        cos_poly = V::set1(-1.13585365213876817300e-11);
+        cos_poly = V::add(V::mul(cos_poly, zz), V::set1(2.08757008419747316778e-9));
+        cos_poly = V::add(V::mul(cos_poly, zz), V::set1(-2.75573141792967388112e-7));
+        cos_poly = V::add(V::mul(cos_poly, zz), V::set1(2.48015872888517045348e-5));
+        cos_poly = V::add(V::mul(cos_poly, zz), V::set1(-1.38888888888730564116e-3));
+        cos_poly = V::add(V::mul(cos_poly, zz), V::set1(4.16666666666665929218e-2));
+    }
+    sin_poly = V::add(z, V::mul(V::mul(z, zz), sin_poly));
+    cos_poly = V::add(V::sub(one, V::mul(V::set1(0.5), zz)), V::mul(V::mul(zz, zz), cos_poly));
+
+    // j = 0: ( S,  C)   j = 2: ( C, -S)   j = 4: (-S, -C)   j = 6: (-C,  S)
+    mask swap = V::mask_or(V::equal(j, two), V::equal(j, V::set1(6.0)));
+    mask sin_negative = V::greater_equal(j, four);
+    mask cos_negative = V::mask_or(V::equal(j, two), V::equal(j, four));
+
+    reg s = V::select(swap, cos_poly, sin_poly);
+    reg c = V::select(swap, sin_poly, cos_poly);
+    s = V::select(sin_negative, V::sub(zero, s), s);
+    c = V::select(cos_negative, V::sub(zero, c), c);
+
+    sin_x = V::select(negative, V::sub(zero, s), s);
+    cos_x = c;
+}
+
+// Constants of the equations of motion, broadcast once per kernel call.
+template <class V, PendulumForm form = PendulumForm::General>
+struct SimdPendulumConstants
+{
+    typename V::reg minus_m12_g_l1;
+    typename V::reg minus_m2_g_l2;
+    typename V::reg m2_l1_l2;
+    typename V::reg b;
+    typename V::reg e;
+
+    SimdPendulumConstants(const PendulumParameters& parameters)
+    : minus_m12_g_l1(V::set1(-(parameters.mass_1 + parameters.mass_2)*parameters.g*parameters.length_1)),
+    minus_m2_g_l2(V::set1(-parameters.mass_2*parameters.g*parameters.length_2)),
+    m2_l1_l2(V::set1(parameters.mass_2*parameters.length_1*parameters.length_2)),
+    b(V::set1((parameters.mass_1 + parameters.mass_2)*parameters.length_1*parameters.length_1)),
+    e(V::set1(parameters.mass_2*parameters.length_2*parameters.length_2))
+    {
+    }
+};
+
+// With equal arms the equations are divided by mass*length^2, which turns the constants of the
+// mass matrix into 2, 1 and 1.
+template <class V>
+struct SimdPendulumConstants<V, PendulumForm::EqualArms>
+{
+    typename V::reg minus_2_g_l;
+    typename V::reg minus_g_l;
+    typename V::reg half;
+
+    SimdPendulumConstants(const PendulumParameters& parameters)
+    : minus_2_g_l(V::set1(-2*parameters.g/parameters.length_1)),
+    minus_g_l(V::set1(-parameters.g/parameters.length_1)),
+    half(V::set1(0.5))
+    {
+    }
+};
+
+template <class V, PendulumForm form>
+inline void simd_pendulum_accelerations(const SimdPendulumConstants<V, form>& constants,
+                                        typename V::reg p1,
+                                        typename V::reg p2,
+                                        typename V::reg w1,
+                                        typename V::reg w2,
+                                        typename V::reg& acc_1,
+                                        typename V::reg& acc_2)
+{
+    using reg = typename V::reg;
+
+    reg sin_1, cos_1, sin_2, cos_2, sin_12, cos_12;
+    simd_sincos<V>(p1, sin_1, cos_1);
+    simd_sincos<V>(p2, sin_2, cos_2);
+    simd_sincos<V>(V::sub(p1, p2), sin_12, cos_12);
+
+    if constexpr (form == PendulumForm::EqualArms) {
+        reg a = V::sub(V::mul(constants.minus_2_g_l, sin_1), V::mul(V::mul(w2, w2), sin_12));
+        reg d = V::add(V::mul(constants.minus_g_l, sin_2), V::mul(V::mul(w1, w1), sin_12));
+        reg half_c = V::mul(constants.half, cos_12);
+
+        acc_2 = V::div(V::sub(d, V::mul(a, half_c)), V::sub(V::set1(1.0), V::mul(cos_12, half_c)));
+        acc_1 = V::sub(V::mul(constants.half, a), V::mul(half_c, acc_2));
+    }
+    else {
+        reg a = V::sub(V::mul(constants.minus_m12_g_l1, sin_1), V::mul(V::mul(V::mul(constants.m2_l1_l2, w2), w2), sin_12));
+        reg c = V::mul(constants.m2_l1_l2, cos_12);
+        reg d = V::add(V::mul(constants.minus_m2_g_l2, sin_2), V::mul(V::mul(V::mul(constants.m2_l1_l2, w1), w1), sin_12));
+
+        acc_2 = V::div(V::sub(d, V::div(V::mul(a, c), constants.b)), V::sub(constants.e, V::div(V::mul(c, c), constants.b)));
+        acc_1 = V::sub(V::div(a, constants.b), V::mul(V::div(c, constants.b), acc_2));
+    }
+}
+
+template <class V, PendulumForm form>
+inline void simd_pendulum_rhs_block(const SimdPendulumConstants<V, form>& constants,
+                                    const double* phi_1,
+                                    const double* phi_2,
+                                    const double* der_phi_1,
+                                    const double* der_phi_2,
+                                    double* acc_1_out,
+                                    double* acc_2_out)
+{
+    typename V::reg acc_1, acc_2;
+    simd_pendulum_accelerations<V>(constants, simd_load<V>(phi_1), simd_load<V>(phi_2),
+                                   simd_load<V>(der_phi_1), simd_load<V>(der_phi_2), acc_1, acc_2);
+    simd_store<V>(acc_1_out, acc_1);
+    simd_store<V>(acc_2_out, acc_2);
+}
+
+// Takes V::width pendulums through all substeps in registers. The operations are those of the
+// RK4 loop of RungeKutta::integrate_tile on the block right-hand side, in the same order, so for
+// doubles the results are bitwise equal.
+template <class V, PendulumForm form>
+inline void simd_pendulum_rk4_substeps(const SimdPendulumConstants<V, form>& constants, typename V::reg y[4], double step, int substeps)
+{
+    using reg = typename V::reg;
+
+    const reg half_step = V::set1(1.0/2 * step);
+    const reg full_step = V::set1(step);
+    const reg sixth_step = V::set1(1.0/6 * step);
+    const reg two = V::set1(2.0);
+
+    for (int substep = 0; substep < substeps; substep++) {
+        reg k[4][4];
+        reg aux[4];
+        // The derivatives of the angles are the angular velocities.
+        k[0][0] = y[2];
+        k[0][1] = y[3];
+        simd_pendulum_accelerations<V>(constants, y[0], y[1], y[2], y[3], k[0][2], k[0][3]);
+        for (int stage = 1; stage < 4; stage++) {
+            const reg& factor = stage < 3 ? half_step : full_step;
+            for (int v = 0; v < 4; v++) {
+                aux[v] = V::add(y[v], V::mul(factor, k[stage - 1][v]));
+            }
+            k[stage][0] = aux[2];
+            k[stage][1] = aux[3];
+            simd_pendulum_accelerations<V>(constants, aux[0], aux[1], aux[2], aux[3], k[stage][2], k[stage][3]);
+        }
+        for (int v = 0; v < 4; v++) {
+            reg sum = V::add(V::add(V::add(k[0][v], V::mul(two, k[1][v])), V::mul(two, k[2][v])), k[3][v]);
+            y[v] = V::add(y[v], V::mul(sixth_step, sum));
+        }
+    }
+}
+
+template <class V, PendulumForm form>
+inline void simd_pendulum_rk4_block(const SimdPendulumConstants<V, form>& constants, double* values[4], double step, int substeps)
+{
+    typename V::reg y[4];
+    for (int v = 0; v < 4; v++) {
+        y[v] = simd_load<V>(values[v]);
+    }
+    simd_pendulum_rk4_substeps<V>(constants, y, step, substeps);
+    for (int v = 0; v < 4; v++) {
+        simd_store<V>(values[v], y[v]);
+    }
+}
+
+// Mixed precision for a vector of floats V: the state and the stages of its V::width pendulums
+// stay in two double registers per value, only the accelerations are computed in V. The results
+// are bitwise equal to RK4 on simd_pendulum_rhs<V>.
+template <class V, PendulumForm form>
+inline void simd_pendulum_rk4_mixed_block(const SimdPendulumConstants<V, form>& constants, double* values[4], double step, int substeps)
+{
+    using D = typename V::double_vector;
+    using reg = typename D::reg;
+
+    const reg half_step = D::set1(1.0/2 * step);
+    const reg full_step = D::set1(step);
+    const reg sixth_step = D::set1(1.0/6 * step);
+    const reg two = D::set1(2.0);
+
+    // Index h selects the lower or upper half of the lanes of V.
+    reg y[2][4];
+    for (int h = 0; h < 2; h++) {
+        for (int v = 0; v < 4; v++) {
+            y[h][v] = D::load(values[v] + h*D::width);
+        }
+    }
+    for (int substep = 0; substep < substeps; substep++) {
+        reg k[4][2][4];
+        reg aux[2][4];
+        for (int stage = 0; stage < 4; stage++) {
+            if (stage > 0) {
+                const reg& factor = stage < 3 ? half_step : full_step;
+                for (int h = 0; h < 2; h++) {
+                    for (int v = 0; v < 4; v++) {
+                        aux[h][v] = D::add(y[h][v], D::mul(factor, k[stage - 1][h][v]));
+                    }
+                }
+            }
+            reg (&input)[2][4] = stage == 0 ? y : aux;
+            typename V::reg acc_1, acc_2;
+            simd_pendulum_accelerations<V>(constants,
+                                           V::narrow(input[0][0], input[1][0]), V::narrow(input[0][1], input[1][1]),
+                                           V::narrow(input[0][2], input[1][2]), V::narrow(input[0][3], input[1][3]),
+                                           acc_1, acc_2);
+            V::widen(acc_1, k[stage][0][2], k[stage][1][2]);
+            V::widen(acc_2, k[stage][0][3], k[stage][1][3]);
+            for (int h = 0; h < 2; h++) {
+                k[stage][h][0] = input[h][2];
+                k[stage][h][1] = input[h][3];
+            }
+        }
+        for (int h = 0; h < 2; h++) {
+            for (int v = 0; v < 4; v++) {
+                reg sum = D::add(D::add(D::add(k[0][h][v], D::mul(two, k[1][h][v])), D::mul(two, k[2][h][v])), k[3][h][v]);
+                y[h][v] = D::add(y[h][v], D::mul(sixth_step, sum));
+            }
+        }
+    }
+    for (int h = 0; h < 2; h++) {
+        for (int v = 0; v < 4; v++) {
+            D::store(values[v] + h*D::width, y[h][v]);
+        }
+    }
+}
+
+// Calls block on the value arrays of every width pendulums of a state. The remainder goes through
+// the same code on a padded copy, so the result for a pendulum does not depend on its position.
+template <int width, class Block>
+inline void simd_for_each_block(double* state, int stride, int count, Block block)
+{
+    int full = count - count % width;
+    for(int n = 0; n < full; n += width){
+        double* values[4] = {state + n, state + stride + n, state + 2*stride + n, state + 3*stride + n};
+        block(values);
+    }
+
+    if(full < count){
+        double padded[4][width] = {};
+        for(int n = full; n < count; n++){
+            for(int v = 0; v < 4; v++){
+                padded[v][n - full] = state[v*stride + n];
+            }
+        }
+        double* values[4] = {padded[0], padded[1], padded[2], padded[3]};
+        block(values);
+        for(int n = full; n < count; n++){
+            for(int v = 0; v < 4; v++){
+                state[v*stride + n] = padded[v][n - full];
+            }
+        }
+    }
+}
+
+template <class V, PendulumForm form>
+void simd_pendulum_rhs(const PendulumParameters& parameters,
+                       const double* state,
+                       double* right_hand_side,
+                       int stride,
+                       int count)
+{
+    const double* phi_1 = state;
+    const double* phi_2 = state + stride;
+    const double* der_phi_1 = state + 2*stride;
+    const double* der_phi_2 = state + 3*stride;
+    const SimdPendulumConstants<V, form> constants(parameters);
+
+    int full = count - count % V::width;
+    for(int n = 0; n < full; n += V::width){
+        simd_pendulum_rhs_block<V>(constants,
+                                   phi_1 + n, phi_2 + n, der_phi_1 + n, der_phi_2 + n,
+                                   right_hand_side + 2*stride + n,
+                                   right_hand_side + 3*stride + n);
+    }
+
+    // The remainder goes through the same vector code on a padded copy, so the result for a
+    // pendulum does not depend on its position in the array.
+    if(full < count){
+        double in[4][V::width] = {};
+        double out[2][V::width];
+        for(int n = full; n < count; n++){
+            in[0][n - full] = phi_1[n];
+            in[1][n - full] = phi_2[n];
+            in[2][n - full] = der_phi_1[n];
+            in[3][n - full] = der_phi_2[n];
+        }
+        simd_pendulum_rhs_block<V>(constants, in[0], in[1], in[2], in[3], out[0], out[1]);
+        for(int n = full; n < count; n++){
+            right_hand_side[2*stride + n] = out[0][n - full];
+            right_hand_side[3*stride + n] = out[1][n - full];
+        }
+    }
+
+    for(int n = 0; n < count; n++){
+        right_hand_side[n] = der_phi_1[n];
+        right_hand_side[stride + n] = der_phi_2[n];
+    }
+}
+
+template <class V, PendulumForm form>
+void simd_pendulum_rk4(const PendulumParameters& parameters,
+                       double* state,
+                       int stride,
+                       int count,
+                       double step,
+                       int substeps)
+{
+    const SimdPendulumConstants<V, form> constants(parameters);
+    simd_for_each_block<V::width>(state, stride, count, [&](double* values[4]) {
+        simd_pendulum_rk4_block<V>(constants, values, step, substeps);
+    });
+}
+
+template <class V, PendulumForm form>
+void simd_pendulum_rk4_mixed(const PendulumParameters& parameters,
+                             double* state,
+                             int stride,
+                             int count,
+                             double step,
+                             int substeps)
+{
+    const SimdPendulumConstants<V, form> constants(parameters);
+    simd_for_each_block<V::width>(state, stride, count, [&](double* values[4]) {
+        simd_pendulum_rk4_mixed_block<V>(constants, values, step, substeps);
+    });
+}
@@ -1,20 +1,23 @@
 #pragma once
 
 #include "System.hpp"
+#include "Pendulum_kernels.hpp"
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cmath>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <vector>
 #include <fstream>
 
-class PendulumSystem : public System
+class PendulumSystem final : public System
 {
     private:
         int size_x;
@@ -24,38 +27,88 @@ class PendulumSystem : public System
         double length_1;
         double length_2;
         std::array<double, 4> bounds;
+        PendulumParameters parameters;
+        InstructionSet instruction_set;
+        Precision precision = Precision::Double;
+        PendulumRhsKernel rhs_kernel;
+        PendulumRk4Kernel rk4_kernel;
+
+        // State is stored as structure of arrays: all phi_1 values first, then phi_2,
+        // der_phi_1 and der_phi_2, each block holding pendulum_count values.
+        int pendulum_count;
+
+        // Pendulums whose trajectories are copied from the frames of an earlier run: pendulum
+        // targets[n] of this system is pendulum sources[n] of the earlier one.
+        struct ReusedTrajectories
+        {
+            std::shared_ptr<FrameSink> frames;
+            int pendulum_count;
+            std::vector<int> targets;
+            std::vector<int> sources;
+        };
+        std::vector<ReusedTrajectories> reused_trajectories;
+
+        // Pendulums the solver may integrate, empty for all of them.
+        std::vector<bool> selected;
+
+        // Point symmetric pendulums: pendulum mirror_targets[n] holds the negated state of
+        // pendulum mirror_sources[n] and is not integrated.
+        std::vector<int> mirror_targets;
+        std::vector<int> mirror_sources;
+
+        // First flip time mode: the time each pendulum first flipped, flip_not_yet before that.
+        // The values are atomic so that the GUI can show them while the solver runs.
+        bool flip_time_mode = false;
+        std::vector<std::atomic<double>> flip_times;
+        std::vector<double> flip_previous_state;
+        double flip_previous_time = 0;
+        int flip_previous_number = -1;
+
+        void update_active_components();
+        void detect_flips(int number);
+        double find_flip_time(int n);
+
+        // The two frames around the last interpolated time with their accelerations, kept while
+        // the time moves between the same frames.
+        int interpolation_frame = -1;
+        std::vector<double> interpolation_states[2];
+        std::vector<double> interpolation_rates[2];
+
+        int get_index(int i, int j){
+            return j*size_x + i;
+        }
 
         double get_phi_1(int i, int j){
-            return state[(j*size_x + i)*4];
+            return state[get_index(i, j)];
         };
         double get_phi_2(int i, int j){
-            return state[(j*size_x + i)*4 + 1];
+            return state[pendulum_count + get_index(i, j)];
         };
         double get_der_phi_1(int i, int j){
-            return state[(j*size_x + i)*4 + 2];
+            return state[2*pendulum_count + get_index(i, j)];
         }
         double get_der_phi_2(int i, int j){
-            return state[(j*size_x + i)*4 + 3];
+            return state[3*pendulum_count + get_index(i, j)];
         }
 
         void set_phi_1(int i, int j, double value){
-            state[(j*size_x + i)*4] = value;
+            state[get_index(i, j)] = value;
         }
         void set_phi_2(int i, int j, double value){
-            state[(j*size_x + i)*4 + 1] = value;
+            state[pendulum_count + get_index(i, j)] = value;
         }
         void set_der_phi_1(int i, int j, double value){
-            state[(j*size_x + i)*4 + 2] = value;
+            state[2*pendulum_count + get_index(i, j)] = value;
         }
         void set_der_phi_2(int i, int j, double value){
-            state[(j*size_x + i)*4 + 3] = value;
+            state[3*pendulum_count + get_index(i, j)] = value;
         }
 
     public:
         // constructor
         PendulumSystem(int size_x,
                     int size_y,
-                    std::array<double, 4>& bounds,
+                    const std::array<double, 4>& bounds,
                     double mass_1,
                     double mass_2,
                     double length_1,
@@ -68,37 +121,143 @@ class PendulumSystem : public System
         length_1(length_1),
         length_2(length_2)
         {
-            this->degrees_of_freedom = size_x * size_y * 4;
+            this->parameters = {mass_1, mass_2, length_1, length_2, 9.81};
+            this->set_instruction_set(get_default_instruction_set());
+            this->pendulum_count = size_x * size_y;
+            this->degrees_of_freedom = pendulum_count * 4;
             this->time = 0;
             state.resize(this->degrees_of_freedom, 0);
+            this->flip_times = std::vector<std::atomic<double>>(pendulum_count);
             this->set_initial_conditions(time);
         }
 
+        // Reopens a run recorded to a history file. The frames are read from the file on demand
+        // and the state is set to the last recorded frame.
+        PendulumSystem(std::shared_ptr<FileFrameSink> history);
+
+        static constexpr double flip_not_yet = -1;
+        static constexpr double flip_never = std::numeric_limits<double>::infinity();
+
+        HistoryHeader get_history_header(double time_step, double integration_step);
+
+        std::array<double, 4> get_bounds(){
+            return bounds;
+        }
+
         std::array<int, 2> get_size(){
             return {this->size_x, this->size_y};
         }
 
+        int get_pendulum_count(){
+            return pendulum_count;
+        }
+
         void set_time_step(double time_step) {
             this->time_step = time_step;
         }
 
+        PendulumParameters get_parameters(){
+            return parameters;
+        }
+
+        InstructionSet get_instruction_set(){
+            return instruction_set;
+        }
+        void set_instruction_set(InstructionSet instruction_set){
+            this->instruction_set = instruction_set;
+            PendulumForm form = get_pendulum_form(parameters);
+            this->rhs_kernel = get_rhs_kernel(instruction_set, precision, form);
+            this->rk4_kernel = get_rk4_kernel(instruction_set, precision, form);
+        }
+
+        // The float precision only takes the RK4 substeps in float with the fused kernel, other
+        // integrations compute as in the mixed precision.
+        Precision get_precision(){
+            return precision;
+        }
+        void set_precision(Precision precision){
+            this->precision = precision;
+            this->set_instruction_set(instruction_set);
+        }
+
+        int get_component_count(){
+            return pendulum_count;
+        }
+        bool is_autonomous(){
+            return true;
+        }
+
         void get_right_hand_side(const double time, const std::vector<double>& state, std::vector<double>& right_hand_side);
+        void get_right_hand_side(const double time, const double* state, double* right_hand_side, int stride, int count);
+        bool has_rk4_kernel(){
+            return true;
+        }
+        void integrate_rk4(double* state, int stride, int count, double step, int substeps){
+            rk4_kernel(parameters, state, stride, count, step, substeps);
+        }
         void set_initial_conditions(const double time);
+        // Takes the trajectories of the target pendulums from the frames of an earlier run with
+        // pendulum_count pendulums instead of integrating them. The frames have to hold every
+        // frame this system records, at the same times.
+        void reuse_trajectories(std::shared_ptr<FrameSink> frames, int pendulum_count,
+                                std::vector<int> targets, std::vector<int> sources);
+        int get_reused_count();
+        // Integrates the reused pendulums again, e.g. to continue the run past the reused frames.
+        void stop_reusing_trajectories(){
+            reused_trajectories.clear();
+            update_active_components();
+        }
+
+        // The equations are odd in the state, so a pendulum starting at the negated state of
+        // another one stays at its negated state. With symmetry enabled, only one pendulum of
+        // each such pair is integrated and the other one mirrors it; pairs are taken where the
+        // grid points match exactly, e.g. for bounds symmetric about the origin. Returns the
+        // number of mirrored pendulums.
+        int set_point_symmetry(bool enabled);
+        // Restricts the integration to the given pendulums, the others keep their state; an
+        // empty list selects all pendulums again. Cannot be combined with point symmetry.
+        void set_integrated_pendulums(const std::vector<int>& pendulums);
+        int get_mirrored_count(){
+            return mirror_targets.size();
+        }
+
+        // In the first flip time mode a pendulum is retired from integration once |phi_1| or
+        // |phi_2| exceeds pi, and the time of the crossing is kept. The recorded frames hold the
+        // retired pendulums at the state in which they flipped.
+        void set_flip_time_mode(bool flip_time_mode);
+        bool is_flip_time_mode(){
+            return flip_time_mode;
+        }
+        // Time of the first flip of the pendulum, flip_not_yet if it has not flipped so far and
+        // flip_never if its energy is too low to lift an arm over the top.
+        double get_flip_time(int i, int j){
+            return flip_times[get_index(i, j)].load(std::memory_order_relaxed);
+        }
+        void set_flip_time(int i, int j, double flip_time){
+            flip_times[get_index(i, j)].store(flip_time, std::memory_order_relaxed);
+        }
+        void complete_frame(int number);
+
+        // Whether interpolate_state can reconstruct the given time from the recorded frames.
+        bool can_interpolate(double time);
+        // State at a time between two recorded frames. The angles follow the quintic Hermite
+        // polynomial through their values, velocities and accelerations at both frames, the
+        // velocities are its derivative; needs a lossless frame sink.
+        void interpolate_state(double time, std::vector<double>& state);
         void write_state_to_file(int number, std::string folder_name);
-        void record_state();
         void save_history_to_folder(std::string folder_name);
 
         double get_phi_1(int i, int j, int number){
-            return get_state_history(number)[(j*size_x + i)*4];
+            return get_history_value(number, get_index(i, j));
         };
         double get_phi_2(int i, int j, int number){
-            return get_state_history(number)[(j*size_x + i)*4 + 1];
+            return get_history_value(number, pendulum_count + get_index(i, j));
         };
         double get_der_phi_1(int i, int j, int number){
-            return get_state_history(number)[(j*size_x + i)*4 + 2];
+            return get_history_value(number, 2*pendulum_count + get_index(i, j));
         }
         double get_der_phi_2(int i, int j, int number){
-            return get_state_history(number)[(j*size_x + i)*4 + 3];
+            return get_history_value(number, 3*pendulum_count + get_index(i, j));
         }
 
 };
\ No newline at end of file
@@ -2,13 +2,32 @@
 
 #include "Pendulum_system.hpp"
 #include "System.hpp"
+#include "Task_scheduler.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <cmath>
 #include <iomanip>
 #include <vector>
+#include <atomic>
 #include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
 
+// Classic RK4 with the fixed integration step, or the embedded Dormand-Prince 5(4) pair which
+// controls the step of every component separately. The adaptive method needs an autonomous
+// system of independent components and uses the integration step as the first step size.
+enum class IntegrationMethod
+{
+    RK4,
+    DormandPrince
+};
+
+// The system type is bound at compile time, so the calls of a final system such as
+// PendulumSystem are resolved statically; RungeKutta<> integrates any System through its virtual
+// functions. Instantiated for System and PendulumSystem in Runge-Kutta.cpp.
+template <class SystemT = System>
 class RungeKutta
 {
     private:
@@ -20,11 +39,101 @@ class RungeKutta
 
         double time_step;
         double integration_step;
-        System *current_system;
+        int degrees_of_freedom;
+        SystemT *current_system;
+
+        // Buffers of one tile: the gathered state and the stages, value v of the n-th component
+        // of the tile at index v*tile_size + n.
+        struct TileBuffers
+        {
+            std::vector<double> state;
+            std::vector<double> k1;
+            std::vector<double> k2;
+            std::vector<double> k3;
+            std::vector<double> k4;
+            std::vector<double> aux;
+
+            // Additional stages and per-component step control of the adaptive method.
+            std::vector<double> k5;
+            std::vector<double> k6;
+            std::vector<double> k7;
+            std::vector<double> step;
+            std::vector<double> current_step;
+            std::vector<double> elapsed;
+            std::vector<int> index;
+        };
+
+        int thread_count = std::max(1u, std::thread::hardware_concurrency());
+        int tile_size = 128;
+        std::vector<TileBuffers> tile_buffers;
+        std::unique_ptr<TaskScheduler> scheduler;
+
+        IntegrationMethod method = IntegrationMethod::RK4;
+        bool fused_kernel = true;
+        bool time_batching = true;
+        double absolute_tolerance = 1e-8;
+        double relative_tolerance = 1e-8;
+        // Step size of every component, kept from one time step to the next.
+        std::vector<double> step_sizes;
+        std::atomic<long long> rhs_evaluations{0};
+
+        std::function<void(double progress, double remaining_time)> progress_callback;
+        std::function<void(int number, double time, const std::vector<double>& state)> frame_callback;
+        const std::atomic<bool>* cancelled = nullptr;
+        bool print_progress = true;
+
+        bool is_cancelled(){
+            return cancelled && cancelled->load();
+        }
+
+        void record_frame(FrameSink& frame_sink);
+        std::vector<double> get_substep_times(double time_max);
+        void integrate_step_tiled(double time_max);
+        // Integrates components first..first+count-1 of the list, or of the whole state when
+        // components is null.
+        void integrate_tile(const int* components, int first, int count, const std::vector<double>& substep_times, TileBuffers& buffers);
+        void integrate_tile_adaptive(const int* components, int first, int count, double start_time, double duration, TileBuffers& buffers);
 
-    
     public:
-        void set_up(System *system, double time_step, double integration_step);
+        void set_up(SystemT *system, double time_step, double integration_step);
+        void set_thread_count(int thread_count);
+        void set_tile_size(int tile_size);
+        void set_method(IntegrationMethod method);
+        // RK4 on tiles uses the fused kernel of the system, when it has one, unless disabled;
+        // the frames are the same either way.
+        void set_fused_kernel(bool fused_kernel);
+        // RK4 on a system of components advances one tile at a time from one time step to the
+        // next unless disabled; a single thread then sweeps the whole state once per substep.
+        // The frames are the same either way.
+        void set_time_batching(bool time_batching);
+        // The adaptive method keeps the local error of every component below
+        // absolute_tolerance + relative_tolerance * |value| in the root mean square norm.
+        void set_tolerances(double absolute_tolerance, double relative_tolerance);
+
+        // Called by solve after every time step with the finished fraction and the estimated
+        // remaining time in seconds.
+        void set_progress_callback(std::function<void(double progress, double remaining_time)> callback);
+        // Called by solve on the solving thread right after a frame was recorded.
+        void set_frame_callback(std::function<void(int number, double time, const std::vector<double>& state)> callback);
+        // Once the flag is set, solve stops at the next tile or time step. The frame being
+        // integrated at that moment is not recorded.
+        void set_cancellation_flag(const std::atomic<bool>* cancelled);
+        // solve prints the progress of every time step and the thread statistics unless disabled.
+        void set_print_progress(bool print_progress);
+        int get_steps_count(double time_max);
+        // Makes room for the frames solve(time_max) records, so that other threads can read the
+        // recorded frames while it runs. solve calls it itself, call it earlier when other
+        // threads may already be reading the frame sink when solve starts.
+        void reserve_frames(double time_max);
+        // Times of the frames solve(time_max) records, starting with the current time.
+        std::vector<double> get_frame_times(double time_max);
         void solve(double time_max);
         void integrate_step(double time_max);
+
+        // Busy and idle time of the threads of the tiled integration, one entry per thread.
+        std::vector<WorkerStatistics> get_thread_statistics();
+        // Right hand side evaluations so far, counted per component for systems of components.
+        long long get_rhs_evaluations(){
+            return rhs_evaluations;
+        }
 };
\ No newline at end of file
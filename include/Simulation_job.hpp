@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Pendulum_image.hpp"
+#include "Pendulum_system.hpp"
+#include "Runge-Kutta.hpp"
+#include "Spsc_queue.hpp"
+#include "Trajectory_cache.hpp"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Integrates a pendulum system on a background thread. Every recorded frame is rendered on that
+// thread and passed to the GUI through a lock-free queue, so the GUI can show it at once; frames
+// are dropped when the GUI falls behind. A cancelled job stops at the next tile or time step.
+class SimulationJob
+{
+    private:
+        std::shared_ptr<PendulumSystem> system;
+        double integration_step;
+        double time_step;
+        IntegrationMethod method;
+        // Pendulums taken from the trajectory cache instead of being integrated.
+        int reused_count = 0;
+        RungeKutta<PendulumSystem> solver;
+        std::thread thread;
+
+        std::atomic<bool> cancelled{false};
+        std::atomic<bool> finished{false};
+        std::atomic<double> progress{0};
+        std::atomic<double> remaining_time{0};
+        std::mutex error_mutex;
+        std::string error_message;
+        SpscQueue<DisplayFrame> display_frames{4};
+
+        void run(double time_max);
+
+    public:
+        // A new system integrated with RK4 takes the pendulums found in the trajectory cache
+        // from there.
+        SimulationJob(std::shared_ptr<PendulumSystem> system, double time_max, double integration_step, double time_step,
+                      TrajectoryCache* trajectory_cache = nullptr, IntegrationMethod method = IntegrationMethod::RK4,
+                      double absolute_tolerance = 1e-8, double relative_tolerance = 1e-8);
+        ~SimulationJob();
+
+        SimulationJob(const SimulationJob&) = delete;
+        SimulationJob& operator=(const SimulationJob&) = delete;
+
+        void cancel(){
+            cancelled = true;
+        }
+        bool is_cancelled(){
+            return cancelled;
+        }
+        bool is_finished(){
+            return finished;
+        }
+        double get_progress(){
+            return progress;
+        }
+        double get_remaining_time(){
+            return remaining_time;
+        }
+        std::string get_error_message();
+
+        bool pop_display_frame(DisplayFrame& frame){
+            return display_frames.try_pop(frame);
+        }
+
+        std::shared_ptr<PendulumSystem> get_system(){
+            return system;
+        }
+        double get_integration_step(){
+            return integration_step;
+        }
+        double get_time_step(){
+            return time_step;
+        }
+        IntegrationMethod get_method(){
+            return method;
+        }
+        int get_reused_count(){
+            return reused_count;
+        }
+};
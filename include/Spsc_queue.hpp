@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+template <class T>
+class SpscQueue
+{
+    private:
+        std::vector<T> slots;
+        // The indices live on separate cache lines, so the two threads do not invalidate each
+        // other's line on every operation.
+        alignas(64) std::atomic<std::size_t> head{0};
+        alignas(64) std::atomic<std::size_t> tail{0};
+
+        std::size_t next(std::size_t index){
+            return index + 1 == slots.size() ? 0 : index + 1;
+        }
+
+    public:
+        SpscQueue(std::size_t capacity)
+        : slots(capacity + 1)
+        {
+        }
+
+        // Returns false and leaves the value untouched when the queue is full.
+        bool try_push(T&& value){
+            std::size_t current_tail = tail.load(std::memory_order_relaxed);
+            std::size_t next_tail = next(current_tail);
+            if (next_tail == head.load(std::memory_order_acquire)) {
+                return false;
+            }
+            slots[current_tail] = std::move(value);
+            tail.store(next_tail, std::memory_order_release);
+            return true;
+        }
+
+        bool try_pop(T& value){
+            std::size_t current_head = head.load(std::memory_order_relaxed);
+            if (current_head == tail.load(std::memory_order_acquire)) {
+                return false;
+            }
+            value = std::move(slots[current_head]);
+            head.store(next(current_head), std::memory_order_release);
+            return true;
+        }
+};
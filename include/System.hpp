@@ -1,4 +1,7 @@
 #pragma once
+#include "Frame_sink.hpp"
+
+#include <memory>
 #include <vector>
 #include <map>
 #include <cmath>
@@ -14,10 +17,16 @@ class System
         double time;
         double time_step;
         std::vector<double> state;
-        std::vector<std::vector<double>> state_history;
+        std::shared_ptr<FrameSink> frame_sink = std::make_shared<InMemoryFrameSink>();
+
+        // Components integrated by the solver when only some of them have to be simulated.
+        bool all_components_active = true;
+        std::vector<int> active_components;
 
-        const std::vector<double>& get_state_history(double time);
-        const std::vector<double>& get_state_history(int number);
+        int get_frame_number(double time);
+        double get_history_value(int number, int index){
+            return frame_sink->get_value(number, index);
+        }
 
     public:
         double get_degrees_of_freedom(){
@@ -29,13 +38,82 @@ class System
         void increase_time(double time_increase){
             time += time_increase;
         }
+        void set_time(double time){
+            this->time = time;
+        }
         std::vector<double>& get_state(){
             return state;
         }
+
+        FrameSink& get_frame_sink(){
+            return *frame_sink;
+        }
+        std::shared_ptr<FrameSink> get_frame_sink_pointer(){
+            return frame_sink;
+        }
+        void set_frame_sink(std::shared_ptr<FrameSink> frame_sink){
+            this->frame_sink = frame_sink;
+        }
+        void record_state(){
+            frame_sink->record(frame_sink->get_frame_count(), time, state);
+        }
+        // Sets the state and time back to a stored frame, e.g. to continue a run from its last frame.
+        void restore_state(int number){
+            for (int k = 0; k < degrees_of_freedom; k++) {
+                state[k] = frame_sink->get_value(number, k);
+            }
+            time = frame_sink->get_frame_time(number);
+        }
         
         virtual void get_right_hand_side(const double time, const std::vector<double>& state, std::vector<double>& right_hand_side) = 0;
+
+        // Systems made of independent components (e.g. a grid of pendulums) store the state as
+        // structure of arrays, value v of component n at state[v*component_count + n], and can be
+        // integrated in tiles. The block version evaluates count components stored with the given
+        // stride. Systems which cannot be split return 0 components.
+        virtual int get_component_count(){
+            return 0;
+        }
+        virtual void get_right_hand_side(const double time, const double* state, double* right_hand_side, int stride, int count){
+            throw std::logic_error("The system cannot be integrated in tiles.");
+        }
+
+        // Systems of components may also advance a block of them through whole RK4 substeps in
+        // one call, with the stages kept in registers. The result has to be bitwise equal to RK4
+        // on the block right hand side.
+        virtual bool has_rk4_kernel(){
+            return false;
+        }
+        virtual void integrate_rk4(double* state, int stride, int count, double step, int substeps){
+            throw std::logic_error("The system has no RK4 kernel.");
+        }
+
+        // The right hand side does not depend on time, so components may be integrated at
+        // different times, as the adaptive integrator does.
+        virtual bool is_autonomous(){
+            return false;
+        }
+
+        // The solver integrates only the active components once a subset was set, the values
+        // of the others are left to complete_frame.
+        bool has_inactive_components(){
+            return !all_components_active;
+        }
+        const std::vector<int>& get_active_components(){
+            return active_components;
+        }
+        void set_active_components(std::vector<int> components){
+            active_components = std::move(components);
+            all_components_active = false;
+        }
+        void activate_all_components(){
+            active_components.clear();
+            all_components_active = true;
+        }
+        // Called right before the current state is recorded as the given frame.
+        virtual void complete_frame(int number){}
+
         virtual void set_initial_conditions(const double time) = 0;
         virtual void write_state_to_file(int number, std::string folder_name) = 0;
-        virtual void record_state() = 0;
         virtual void save_history_to_folder(std::string folder_name) = 0;
 };
\ No newline at end of file
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+struct WorkerStatistics
+{
+    double busy_time = 0;
+    double idle_time = 0;
+    long long tasks_executed = 0;
+    long long tasks_stolen = 0;
+};
+
+// Persistent pool of threads running batches of independent tasks. Every worker starts with a
+// contiguous range of the tasks and processes it from the front; a worker which runs out of
+// tasks steals from the back of the other workers' queues. The calling thread acts as worker 0.
+class TaskScheduler
+{
+    private:
+        struct WorkerQueue
+        {
+            std::mutex mutex;
+            std::deque<int> tasks;
+        };
+
+        int thread_count;
+        std::vector<std::thread> threads;
+        std::vector<std::unique_ptr<WorkerQueue>> queues;
+        std::vector<WorkerStatistics> statistics;
+
+        std::mutex mutex;
+        std::condition_variable start_condition;
+        std::condition_variable finish_condition;
+        long long generation = 0;
+        int running_workers = 0;
+        bool stopping = false;
+        const std::function<void(int, int)>* current_task = nullptr;
+        // First exception thrown by a task of the current batch.
+        std::exception_ptr error;
+
+        void worker_loop(int worker);
+        void process_tasks(int worker);
+        bool take_task(int worker, int& task, bool& stolen);
+        void drop_tasks();
+
+    public:
+        TaskScheduler(int thread_count);
+        ~TaskScheduler();
+
+        int get_thread_count(){
+            return thread_count;
+        }
+
+        // Calls task(worker, i) for every i in [0, task_count) and returns when all have finished.
+        // When a task throws, the tasks not yet started are dropped and the first exception is
+        // rethrown on the calling thread once the running ones have finished.
+        void run(int task_count, const std::function<void(int worker, int task)>& task);
+
+        const std::vector<WorkerStatistics>& get_statistics(){
+            return statistics;
+        }
+        void reset_statistics();
+        void print_statistics(std::ostream& stream);
+};
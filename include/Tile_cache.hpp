@@ -0,0 +1,90 @@
+#pragma once
+
+#include "Tile_pyramid.hpp"
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Header of a tile file, it holds everything the pixels depend on. It is followed by run_count
+// runs of equal pixels, each a 16-bit count and the RGB colour. The version changes with the
+// rounding of the kernels, so tiles of older kernels are recomputed.
+struct TileHeader
+{
+    char magic[8] = {'D', 'P', 'T', 'I', 'L', 'E', '\0', '\0'};
+    std::uint32_t version = 2;
+    std::uint32_t header_size = 160;
+    std::int32_t size_x = 0;
+    std::int32_t size_y = 0;
+    std::array<double, 4> bounds = {};
+    double mass_1 = 0;
+    double mass_2 = 0;
+    double length_1 = 0;
+    double length_2 = 0;
+    double integration_step = 0;
+    double time_step = 0;
+    double time_max = 0;
+    double absolute_tolerance = 0;
+    double relative_tolerance = 0;
+    std::int32_t method = 0;
+    std::int32_t instruction_set = 0;
+    std::int32_t flip_time_mode = 0;
+    std::int32_t tile_size = 0;
+    std::int32_t level = 0;
+    std::int32_t x = 0;
+    std::int32_t y = 0;
+    std::uint32_t run_count = 0;
+};
+static_assert(sizeof(TileHeader) == 160, "The tile header has to have the same layout on all platforms.");
+
+// Tile images kept on disk between sessions, one file per tile in a directory which may be shared
+// by several processes. When the files outgrow the disk capacity, the least recently used ones
+// are deleted; the most recently used tiles are also kept in memory.
+class TileCache
+{
+    private:
+        struct DiskEntry
+        {
+            std::list<std::string>::iterator position;
+            std::uintmax_t size;
+        };
+        struct MemoryEntry
+        {
+            std::list<std::string>::iterator position;
+            std::vector<unsigned char> pixels;
+        };
+
+        std::string directory;
+        std::uintmax_t disk_capacity;
+        int memory_capacity;
+
+        std::mutex mutex;
+        // Most recently used first.
+        std::list<std::string> disk_order;
+        std::unordered_map<std::string, DiskEntry> disk_files;
+        std::uintmax_t disk_usage = 0;
+        std::list<std::string> memory_order;
+        std::unordered_map<std::string, MemoryEntry> memory_tiles;
+        long long hit_count = 0;
+        long long miss_count = 0;
+
+        std::string get_file_name(const TileHeader& header);
+        void touch_disk_file(const std::string& file_name, std::uintmax_t size);
+        void forget_disk_file(const std::string& file_name);
+        void keep_in_memory(const std::string& file_name, const std::vector<unsigned char>& pixels);
+        bool read_tile_file(const std::string& file_name, const TileHeader& header, std::vector<unsigned char>& pixels);
+
+    public:
+        TileCache(std::string directory, std::uintmax_t disk_capacity = 512ull << 20, int memory_capacity = 256);
+
+        // Both are safe to call from several threads.
+        bool load(const TileSettings& settings, const TileKey& key, int tile_size, std::vector<unsigned char>& pixels);
+        void store(const TileSettings& settings, const TileKey& key, int tile_size, const std::vector<unsigned char>& pixels);
+
+        std::uintmax_t get_disk_usage();
+        long long get_hit_count();
+        long long get_miss_count();
+};
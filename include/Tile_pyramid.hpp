@@ -0,0 +1,131 @@
+#pragma once
+
+#include "Pendulum_image.hpp"
+#include "Pendulum_system.hpp"
+#include "Runge-Kutta.hpp"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// Everything which determines the pixels of a tile apart from its position.
+struct TileSettings
+{
+    // The grid of level 0, it is the grid of the run being zoomed into.
+    int size_x;
+    int size_y;
+    std::array<double, 4> bounds;
+    double mass_1;
+    double mass_2;
+    double length_1;
+    double length_2;
+    double integration_step;
+    double time_step;
+    double time_max;
+    IntegrationMethod method;
+    double absolute_tolerance;
+    double relative_tolerance;
+    bool flip_time_mode;
+    InstructionSet instruction_set;
+
+    bool operator==(const TileSettings& other) const {
+        return size_x == other.size_x && size_y == other.size_y && bounds == other.bounds
+               && mass_1 == other.mass_1 && mass_2 == other.mass_2 && length_1 == other.length_1
+               && length_2 == other.length_2 && integration_step == other.integration_step
+               && time_step == other.time_step && time_max == other.time_max && method == other.method
+               && absolute_tolerance == other.absolute_tolerance && relative_tolerance == other.relative_tolerance
+               && flip_time_mode == other.flip_time_mode && instruction_set == other.instruction_set;
+    }
+    bool operator!=(const TileSettings& other) const {
+        return !(*this == other);
+    }
+};
+
+// Level 0 has the pixels of the grid itself and every level doubles the resolution. Tiles are
+// counted from the top left corner of the image, like the rows of a rendered image.
+struct TileKey
+{
+    int level;
+    int x;
+    int y;
+
+    bool operator<(const TileKey& other) const {
+        return std::tie(level, x, y) < std::tie(other.level, other.x, other.y);
+    }
+    bool operator==(const TileKey& other) const {
+        return level == other.level && x == other.x && y == other.y;
+    }
+};
+
+// Bounds of the pendulum system whose pendulums sit at the pixel centres of the tile. The pixels
+// of level 0 are the pendulums of the grid, so the image of a level covers the bounds shrunk by
+// half a pixel of level 0 on every side.
+std::array<double, 4> get_tile_bounds(const TileSettings& settings, const TileKey& key, int tile_size);
+
+// Integrates the pendulums of a tile and renders its image. Returns false when it was cancelled.
+bool render_tile(const TileSettings& settings, const TileKey& key, int tile_size, std::vector<unsigned char>& pixels,
+                 int thread_count = 0, const std::atomic<bool>* cancelled = nullptr);
+
+class TileCache;
+
+// Images of square tiles of a map at its maximum time, computed on demand on a background thread
+// and kept for the lifetime of the settings. Requested tiles are computed in the order given, a
+// new request replaces the tiles still waiting. With a tile cache, tiles are looked up there
+// before they are computed and stored there afterwards.
+class TilePyramid
+{
+    private:
+        int tile_size;
+        TileSettings settings{};
+        // Changes with the settings, so that a tile of old settings is never stored.
+        int generation = 0;
+
+        TileCache* tile_cache = nullptr;
+        // The pixels of a tile are handed out once, its owner keeps them until it releases the tile.
+        std::set<TileKey> tiles;
+        std::deque<TileKey> pending;
+        std::deque<std::pair<TileKey, std::vector<unsigned char>>> finished;
+        bool computing = false;
+        TileKey computed_key{};
+        std::string error_message;
+
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::atomic<bool> cancelled{false};
+        bool stopping = false;
+        std::thread thread;
+
+        void run();
+
+    public:
+        // The tile cache has to outlive the pyramid.
+        TilePyramid(int tile_size = 256, TileCache* tile_cache = nullptr);
+        ~TilePyramid();
+
+        TilePyramid(const TilePyramid&) = delete;
+        TilePyramid& operator=(const TilePyramid&) = delete;
+
+        // New settings drop all tiles and cancel the tile being computed.
+        void set_settings(const TileSettings& settings);
+        int get_generation();
+        int get_tile_size(){
+            return tile_size;
+        }
+
+        void request_tiles(const std::vector<TileKey>& keys);
+        bool is_busy();
+        // Hands out every computed tile once, e.g. for uploading it to a texture.
+        bool pop_finished_tile(TileKey& key, std::vector<unsigned char>& pixels);
+        // The owner dropped the pixels of the tile, a later request hands them out again.
+        void release_tile(const TileKey& key);
+        // Returns the error of a failed tile once, an empty string otherwise.
+        std::string take_error_message();
+};
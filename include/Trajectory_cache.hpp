@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Pendulum_system.hpp"
+
+#include <array>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Finished runs whose trajectories new runs can copy instead of integrating them again. A
+// pendulum is reused when a cached run has the same physics, time steps and kernel and a pendulum
+// starting from the bitwise same state, e.g. every other pendulum after the resolution was
+// raised from n to 2n+1 over the same bounds.
+class TrajectoryCache
+{
+    private:
+        typedef std::array<double, 4> InitialCondition;
+
+        struct InitialConditionHash
+        {
+            std::size_t operator()(const InitialCondition& condition) const;
+        };
+        struct InitialConditionEqual
+        {
+            bool operator()(const InitialCondition& a, const InitialCondition& b) const;
+        };
+
+        struct CachedRun
+        {
+            std::shared_ptr<PendulumSystem> system;
+            double integration_step;
+            double time_step;
+            std::unordered_map<InitialCondition, int, InitialConditionHash, InitialConditionEqual> pendulums;
+        };
+
+        int capacity;
+        // Newest run first.
+        std::deque<CachedRun> runs;
+
+        bool is_compatible(CachedRun& run, PendulumSystem& system, double integration_step, double time_step,
+                           const std::vector<double>& frame_times);
+
+    public:
+        TrajectoryCache(int capacity = 2);
+
+        // The system has to keep its frames unchanged while it is cached; only lossless runs
+        // which stored every frame are taken.
+        void add(std::shared_ptr<PendulumSystem> system, double integration_step, double time_step);
+        void clear();
+
+        // Lets the system copy every pendulum found in the cache instead of integrating it. The
+        // system has to be at its initial state, frame_times are the times of all frames the
+        // run will record. Returns the number of reused pendulums.
+        int reuse(PendulumSystem& system, double integration_step, double time_step, const std::vector<double>& frame_times);
+};
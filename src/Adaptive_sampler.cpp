@@ -0,0 +1,209 @@
+#include "Adaptive_sampler.hpp"
+#include "Pendulum_image.hpp"
+
+AdaptiveSampler::AdaptiveSampler(std::shared_ptr<PendulumSystem> system, double integration_step, double time_step)
+: system(system),
+integration_step(integration_step),
+time_step(time_step)
+{
+    this->size_x = system->get_size()[0];
+    this->size_y = system->get_size()[1];
+}
+
+void AdaptiveSampler::set_coarse_cell_size(int coarse_cell_size)
+{
+    if (coarse_cell_size < 1)
+        throw std::invalid_argument("Coarse cell size has to be positive.");
+    this->coarse_cell_size = coarse_cell_size;
+}
+
+void AdaptiveSampler::set_tolerance(double tolerance)
+{
+    if (tolerance < 0)
+        throw std::invalid_argument("Refinement tolerance cannot be negative.");
+    this->tolerance = tolerance;
+}
+
+void AdaptiveSampler::set_thread_count(int thread_count)
+{
+    if (thread_count < 0)
+        throw std::invalid_argument("Thread count cannot be negative.");
+    this->thread_count = thread_count;
+}
+
+void AdaptiveSampler::set_method(IntegrationMethod method, double absolute_tolerance, double relative_tolerance)
+{
+    this->method = method;
+    this->absolute_tolerance = absolute_tolerance;
+    this->relative_tolerance = relative_tolerance;
+}
+
+void AdaptiveSampler::integrate(std::vector<int>& pendulums, double time_max)
+{
+    if (pendulums.empty())
+        return;
+
+    // Every level integrates its new pendulums from the initial time in one run, so they still
+    // share the tiles and the vector kernels.
+    system->set_time(0);
+    system->set_frame_sink(std::make_shared<DiscardFrameSink>(nullptr));
+    system->set_integrated_pendulums(pendulums);
+    RungeKutta<PendulumSystem> solver;
+    solver.set_up(system.get(), time_step, integration_step);
+    solver.set_print_progress(false);
+    solver.set_method(method);
+    solver.set_tolerances(absolute_tolerance, relative_tolerance);
+    if (thread_count > 0) {
+        solver.set_thread_count(thread_count);
+    }
+    solver.solve(time_max);
+
+    for (int n : pendulums) {
+        integrated[n] = true;
+    }
+    integrated_count += pendulums.size();
+    pendulums.clear();
+}
+
+bool AdaptiveSampler::agree(int a, int b, double time_max)
+{
+    std::vector<double>& state = system->get_state();
+    int pendulum_count = system->get_pendulum_count();
+    if (system->is_flip_time_mode()) {
+        double flip_a = system->get_flip_time(a % size_x, a / size_x);
+        double flip_b = system->get_flip_time(b % size_x, b / size_x);
+        bool shown_a = flip_a != PendulumSystem::flip_not_yet && flip_a <= time_max;
+        bool shown_b = flip_b != PendulumSystem::flip_not_yet && flip_b <= time_max;
+        if (shown_a != shown_b)
+            return false;
+        return !shown_a || std::abs(std::log1p(flip_a) - std::log1p(flip_b)) <= tolerance;
+    }
+    auto quadrant = [&](int n) {
+        return 2*(normalize_angle(state[n]) > PI) + (normalize_angle(state[pendulum_count + n]) > PI);
+    };
+    return quadrant(a) == quadrant(b);
+}
+
+void AdaptiveSampler::fill(const Cell& cell, double time_max)
+{
+    std::vector<double>& state = system->get_state();
+    int pendulum_count = system->get_pendulum_count();
+    int corner = cell.y0*size_x + cell.x0;
+    double flip_corners[4] = {
+        system->get_flip_time(cell.x0, cell.y0), system->get_flip_time(cell.x1, cell.y0),
+        system->get_flip_time(cell.x0, cell.y1), system->get_flip_time(cell.x1, cell.y1)
+    };
+    bool flipped = flip_corners[0] != PendulumSystem::flip_not_yet && flip_corners[0] <= time_max;
+
+    for (int j = cell.y0; j <= cell.y1; j++) {
+        for (int i = cell.x0; i <= cell.x1; i++) {
+            int n = j*size_x + i;
+            if (integrated[n])
+                continue;
+            if (system->is_flip_time_mode()) {
+                // Bilinear in the logarithm of the flip time, as the colours are.
+                double flip_time = flip_corners[0];
+                if (flipped) {
+                    double u = cell.x1 > cell.x0 ? static_cast<double>(i - cell.x0) / (cell.x1 - cell.x0) : 0;
+                    double w = cell.y1 > cell.y0 ? static_cast<double>(j - cell.y0) / (cell.y1 - cell.y0) : 0;
+                    double logarithm = (1 - w)*((1 - u)*std::log1p(flip_corners[0]) + u*std::log1p(flip_corners[1]))
+                                       + w*((1 - u)*std::log1p(flip_corners[2]) + u*std::log1p(flip_corners[3]));
+                    flip_time = std::expm1(logarithm);
+                }
+                system->set_flip_time(i, j, flip_time);
+            }
+            for (int v = 0; v < 4; v++) {
+                state[v*pendulum_count + n] = state[v*pendulum_count + corner];
+            }
+        }
+    }
+}
+
+void AdaptiveSampler::sample(double time_max)
+{
+    int pendulum_count = system->get_pendulum_count();
+    integrated.assign(pendulum_count, false);
+    integrated_count = 0;
+
+    std::vector<int> xs;
+    std::vector<int> ys;
+    for (int x = 0; x < size_x - 1; x += coarse_cell_size) {
+        xs.push_back(x);
+    }
+    xs.push_back(size_x - 1);
+    for (int y = 0; y < size_y - 1; y += coarse_cell_size) {
+        ys.push_back(y);
+    }
+    ys.push_back(size_y - 1);
+
+    std::vector<int> pendulums;
+    std::vector<bool> queued(pendulum_count, false);
+    auto queue = [&](int i, int j) {
+        int n = j*size_x + i;
+        if (!integrated[n] && !queued[n]) {
+            queued[n] = true;
+            pendulums.push_back(n);
+        }
+    };
+
+    // Uniform cells are filled at the end, their edges can still be refined by a neighbour.
+    std::vector<Cell> cells;
+    std::vector<Cell> uniform_cells;
+    for (int y : ys) {
+        for (int x : xs) {
+            queue(x, y);
+        }
+    }
+    for (int b = 0; b + 1 < ys.size(); b++) {
+        for (int a = 0; a + 1 < xs.size(); a++) {
+            cells.push_back({xs[a], xs[a + 1], ys[b], ys[b + 1]});
+        }
+    }
+    integrate(pendulums, time_max);
+
+    while (!cells.empty()) {
+        std::vector<Cell> refined;
+        for (const Cell& cell : cells) {
+            if (cell.x1 - cell.x0 <= 1 && cell.y1 - cell.y0 <= 1)
+                continue;
+            int corners[4] = {cell.y0*size_x + cell.x0, cell.y0*size_x + cell.x1,
+                              cell.y1*size_x + cell.x0, cell.y1*size_x + cell.x1};
+            bool uniform = true;
+            for (int k = 1; k < 4; k++) {
+                uniform = uniform && agree(corners[0], corners[k], time_max);
+            }
+            if (uniform) {
+                uniform_cells.push_back(cell);
+                continue;
+            }
+
+            // Halve the sides longer than one pixel.
+            int xm = cell.x1 - cell.x0 > 1 ? (cell.x0 + cell.x1) / 2 : cell.x0;
+            int ym = cell.y1 - cell.y0 > 1 ? (cell.y0 + cell.y1) / 2 : cell.y0;
+            std::vector<int> x_splits = {cell.x0};
+            if (xm != cell.x0) x_splits.push_back(xm);
+            x_splits.push_back(cell.x1);
+            std::vector<int> y_splits = {cell.y0};
+            if (ym != cell.y0) y_splits.push_back(ym);
+            y_splits.push_back(cell.y1);
+
+            for (int y : y_splits) {
+                for (int x : x_splits) {
+                    queue(x, y);
+                }
+            }
+            for (int b = 0; b + 1 < y_splits.size(); b++) {
+                for (int a = 0; a + 1 < x_splits.size(); a++) {
+                    refined.push_back({x_splits[a], x_splits[a + 1], y_splits[b], y_splits[b + 1]});
+                }
+            }
+        }
+        integrate(pendulums, time_max);
+        cells = std::move(refined);
+    }
+    for (const Cell& cell : uniform_cells) {
+        fill(cell, time_max);
+    }
+
+    system->set_integrated_pendulums({});
+}
@@ -0,0 +1,357 @@
+#include "Frame_sink.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+
+double FrameSink::get_frame_time(int number)
+{
+    if (number < 0 || number >= get_frame_count()) {
+        std::stringstream message;
+        message << "Frame " << number << " was not recorded.";
+        throw std::invalid_argument(message.str());
+    }
+    return frame_times[number];
+}
+
+void FrameSink::register_frame(int number, double time)
+{
+    if (number != frame_times.size()) {
+        std::stringstream message;
+        message << "Frame " << number << " recorded out of order, expected frame " << frame_times.size() << ".";
+        throw std::invalid_argument(message.str());
+    }
+    frame_times.push_back(time);
+}
+
+void FrameSink::check_frame(int number)
+{
+    if (get_frame_count() == 0) {
+        throw std::runtime_error("State history is empty");
+    }
+    if (!has_frame(number)) {
+        std::stringstream message;
+        message << "Frame " << number << " is not stored in the frame sink.";
+        throw std::invalid_argument(message.str());
+    }
+}
+
+void InMemoryFrameSink::reserve(int frame_count)
+{
+    FrameSink::reserve(frame_count);
+    frames.reserve(frame_count);
+}
+
+void InMemoryFrameSink::record(int number, double time, const std::vector<double>& state)
+{
+    register_frame(number, time);
+    frames.push_back(state);
+    publish_frame(number);
+}
+
+bool InMemoryFrameSink::has_frame(int number)
+{
+    return number >= 0 && number < get_frame_count();
+}
+
+double InMemoryFrameSink::get_value(int number, int index)
+{
+    check_frame(number);
+    return frames[number][index];
+}
+
+RingBufferFrameSink::RingBufferFrameSink(int capacity)
+: capacity(capacity)
+{
+    if (capacity < 1)
+        throw std::invalid_argument("Capacity of the ring buffer has to be positive.");
+    frames.reserve(capacity);
+}
+
+void RingBufferFrameSink::record(int number, double time, const std::vector<double>& state)
+{
+    register_frame(number, time);
+    if (frames.size() < capacity) {
+        frames.push_back(state);
+    }
+    else {
+        // Reuses the storage of the oldest frame, so the memory stays constant.
+        std::vector<double>& frame = frames[number % capacity];
+        std::copy(state.begin(), state.end(), frame.begin());
+    }
+    publish_frame(number);
+}
+
+bool RingBufferFrameSink::has_frame(int number)
+{
+    return number >= 0 && number < get_frame_count() && number >= get_frame_count() - capacity;
+}
+
+double RingBufferFrameSink::get_value(int number, int index)
+{
+    check_frame(number);
+    return frames[number % capacity][index];
+}
+
+FileFrameSink::FileFrameSink(std::string file_path, const HistoryHeader& header)
+: file_path(file_path),
+header(header)
+{
+    this->header.frame_count = 0;
+    file.open(file_path, std::fstream::in | std::fstream::out | std::fstream::trunc | std::fstream::binary);
+    if (!file) {
+        throw std::ios_base::failure("Unable to open the file: " + file_path);
+    }
+    write_header();
+    mapping = std::make_unique<MappedFile>(file_path);
+}
+
+FileFrameSink::FileFrameSink(std::string file_path)
+: file_path(file_path)
+{
+    file.open(file_path, std::fstream::in | std::fstream::out | std::fstream::binary);
+    if (!file) {
+        throw std::ios_base::failure("Unable to open the file: " + file_path);
+    }
+    mapping = std::make_unique<MappedFile>(file_path);
+
+    // Version 1 headers end before value_size, which keeps its default of doubles.
+    const HistoryHeader expected;
+    const std::size_t version_1_size = offsetof(HistoryHeader, value_size);
+    if (mapping->size() < version_1_size) {
+        throw std::runtime_error("The file " + file_path + " is not a history file.");
+    }
+    std::memcpy(reinterpret_cast<char*>(&header), mapping->data(), version_1_size);
+    if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0) {
+        throw std::runtime_error("The file " + file_path + " is not a history file.");
+    }
+    if (header.version == 1 && header.header_size == version_1_size) {
+        header.value_size = sizeof(double);
+    }
+    else if (header.version == expected.version && header.header_size == expected.header_size
+             && mapping->size() >= sizeof(HistoryHeader)) {
+        std::memcpy(&header, mapping->data(), sizeof(HistoryHeader));
+        if (header.value_size != sizeof(double) && header.value_size != sizeof(float)) {
+            throw std::runtime_error("The history file " + file_path + " has values of unsupported size.");
+        }
+    }
+    else {
+        throw std::runtime_error("The history file " + file_path + " has unsupported version " + std::to_string(header.version) + ".");
+    }
+    if (mapping->size() < get_record_offset(header.frame_count)) {
+        throw std::runtime_error("The history file " + file_path + " is truncated.");
+    }
+
+    for (int number = 0; number < header.frame_count; number++) {
+        double time;
+        std::memcpy(&time, mapping->data() + get_record_offset(number), sizeof(double));
+        frame_times.push_back(time);
+    }
+    frame_count = header.frame_count;
+}
+
+void FileFrameSink::write_header()
+{
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), header.header_size);
+    file.flush();
+    if (!file) {
+        throw std::ios_base::failure("Unable to write to the file: " + file_path);
+    }
+}
+
+void FileFrameSink::record(int number, double time, const std::vector<double>& state)
+{
+    if (header.values_per_frame == 0) {
+        header.values_per_frame = state.size();
+    }
+    if (state.size() != header.values_per_frame) {
+        throw std::invalid_argument("All frames written to one file have to have the same size.");
+    }
+    register_frame(number, time);
+
+    file.seekp(get_record_offset(number));
+    file.write(reinterpret_cast<const char*>(&time), sizeof(double));
+    if (header.value_size == sizeof(float)) {
+        std::vector<float> values(state.begin(), state.end());
+        file.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(float));
+    }
+    else {
+        file.write(reinterpret_cast<const char*>(state.data()), state.size() * sizeof(double));
+    }
+
+    // The frame count is updated only after the frame itself, so a file cut short by a crash
+    // still opens with the frames written completely.
+    file.flush();
+    header.frame_count = number + 1;
+    write_header();
+    publish_frame(number);
+}
+
+bool FileFrameSink::has_frame(int number)
+{
+    return number >= 0 && number < get_frame_count();
+}
+
+double FileFrameSink::get_value(int number, int index)
+{
+    check_frame(number);
+    std::uint64_t offset = get_record_offset(number) + sizeof(double) + static_cast<std::uint64_t>(index) * header.value_size;
+    {
+        std::shared_lock<std::shared_mutex> lock(mapping_mutex);
+        if (offset + header.value_size <= mapping->size())
+            return read_value(offset);
+    }
+    std::unique_lock<std::shared_mutex> lock(mapping_mutex);
+    // Another reader may have remapped the file in the meantime.
+    if (offset + header.value_size > mapping->size()) {
+        mapping->remap();
+    }
+    return read_value(offset);
+}
+
+double FileFrameSink::read_value(std::uint64_t offset)
+{
+    if (header.value_size == sizeof(float)) {
+        float value;
+        std::memcpy(&value, mapping->data() + offset, sizeof(float));
+        return value;
+    }
+    double value;
+    std::memcpy(&value, mapping->data() + offset, sizeof(double));
+    return value;
+}
+
+QuantizedFrameSink::QuantizedFrameSink(bool store_velocities)
+: store_velocities(store_velocities)
+{
+}
+
+void QuantizedFrameSink::reserve(int frame_count)
+{
+    FrameSink::reserve(frame_count);
+    frames.reserve(frame_count);
+}
+
+void QuantizedFrameSink::record(int number, double time, const std::vector<double>& state)
+{
+    if (state.size() % 4 != 0) {
+        throw std::invalid_argument("Quantized frames can only store states of pendulum systems.");
+    }
+    if (pendulum_count == 0) {
+        pendulum_count = state.size() / 4;
+    }
+    if (state.size() != 4 * pendulum_count) {
+        throw std::invalid_argument("All quantized frames have to have the same size.");
+    }
+    register_frame(number, time);
+
+    std::vector<std::uint16_t> frame((store_velocities ? 4 : 2) * pendulum_count);
+    for (int k = 0; k < 2 * pendulum_count; k++) {
+        frame[k] = quantize_angle(state[k]);
+    }
+    if (store_velocities) {
+        for (int k = 2 * pendulum_count; k < 4 * pendulum_count; k++) {
+            frame[k] = to_half(state[k]);
+        }
+    }
+    frames.push_back(std::move(frame));
+    publish_frame(number);
+}
+
+bool QuantizedFrameSink::has_frame(int number)
+{
+    return number >= 0 && number < get_frame_count();
+}
+
+double QuantizedFrameSink::get_value(int number, int index)
+{
+    check_frame(number);
+    if (index < 2 * pendulum_count) {
+        return dequantize_angle(frames[number][index]);
+    }
+    if (!store_velocities) {
+        throw std::invalid_argument("The quantized frames do not store the angular velocities.");
+    }
+    return from_half(frames[number][index]);
+}
+
+std::uint16_t QuantizedFrameSink::quantize_angle(double angle)
+{
+    const double two_pi = 6.283185307179586;
+    double normal_angle = angle - std::floor(angle / two_pi) * two_pi;
+    return static_cast<std::uint32_t>(std::lround(normal_angle / two_pi * 65536.0)) & 0xFFFF;
+}
+
+double QuantizedFrameSink::dequantize_angle(std::uint16_t value)
+{
+    const double two_pi = 6.283185307179586;
+    return value * (two_pi / 65536.0);
+}
+
+std::uint16_t QuantizedFrameSink::to_half(double value)
+{
+    std::uint16_t sign = std::signbit(value) ? 0x8000 : 0;
+    double magnitude = std::abs(value);
+    if (std::isnan(value)) {
+        return sign | 0x7E00;
+    }
+    if (magnitude >= 65520.0) {
+        return sign | 0x7C00;
+    }
+    if (magnitude < std::ldexp(1.0, -14)) {
+        // Subnormal numbers are multiples of 2^-24.
+        return sign | static_cast<std::uint16_t>(std::nearbyint(magnitude * std::ldexp(1.0, 24)));
+    }
+    int exponent;
+    double mantissa = std::frexp(magnitude, &exponent);
+    // magnitude = mantissa * 2^exponent with mantissa in [0.5, 1), i.e. 11 significant bits are
+    // mantissa * 2^11; rounding may carry into the exponent, which the addition below handles.
+    std::uint32_t significand = static_cast<std::uint32_t>(std::nearbyint(mantissa * 2048.0));
+    std::uint32_t bits = (static_cast<std::uint32_t>(exponent + 14) << 10) + (significand - 1024);
+    return sign | static_cast<std::uint16_t>(bits);
+}
+
+double QuantizedFrameSink::from_half(std::uint16_t value)
+{
+    double sign = (value & 0x8000) ? -1.0 : 1.0;
+    int exponent = (value >> 10) & 0x1F;
+    int mantissa = value & 0x3FF;
+    if (exponent == 0) {
+        return sign * std::ldexp(mantissa, -24);
+    }
+    if (exponent == 31) {
+        return mantissa ? std::nan("") : sign * std::numeric_limits<double>::infinity();
+    }
+    return sign * std::ldexp(mantissa + 1024, exponent - 25);
+}
+
+DiscardFrameSink::DiscardFrameSink(std::function<void(int number, double time, const std::vector<double>& state)> callback)
+: callback(callback)
+{
+}
+
+void DiscardFrameSink::record(int number, double time, const std::vector<double>& state)
+{
+    register_frame(number, time);
+    if (callback) {
+        callback(number, time, state);
+    }
+    publish_frame(number);
+}
+
+bool DiscardFrameSink::has_frame(int number)
+{
+    return false;
+}
+
+double DiscardFrameSink::get_value(int number, int index)
+{
+    check_frame(number);
+    return 0;
+}
@@ -0,0 +1,178 @@
+#include "Job_description.hpp"
+
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+    std::string trim(const std::string& text)
+    {
+        std::size_t first = text.find_first_not_of(" \t\r\n");
+        if (first == std::string::npos)
+            return "";
+        std::size_t last = text.find_last_not_of(" \t\r\n");
+        return text.substr(first, last - first + 1);
+    }
+
+    template <class T>
+    T parse_value(const std::string& key, const std::string& value)
+    {
+        std::istringstream stream(value);
+        T result;
+        if (!(stream >> result) || !(stream >> std::ws).eof())
+            throw std::invalid_argument("Invalid value of " + key + ": " + value);
+        return result;
+    }
+
+    template <>
+    bool parse_value<bool>(const std::string& key, const std::string& value)
+    {
+        if (value == "true" || value == "1")
+            return true;
+        if (value == "false" || value == "0")
+            return false;
+        throw std::invalid_argument("Invalid value of " + key + ": " + value);
+    }
+
+    template <class T>
+    void check_range(const std::string& key, T value, bool allow_zero)
+    {
+        if (value > 0 || (allow_zero && value == 0))
+            return;
+        std::ostringstream message;
+        message << "The value of " << key << " has to be " << (allow_zero ? "non-negative" : "positive") << ": " << value;
+        throw std::invalid_argument(message.str());
+    }
+
+    template <class T>
+    void check_positive(const std::string& key, T value)
+    {
+        check_range(key, value, false);
+    }
+
+    template <class T>
+    void check_non_negative(const std::string& key, T value)
+    {
+        check_range(key, value, true);
+    }
+}
+
+void set_job_value(JobDescription& job, const std::string& key, const std::string& value)
+{
+    if (key == "name") job.name = value;
+    else if (key == "size_x") job.size_x = parse_value<int>(key, value);
+    else if (key == "size_y") job.size_y = parse_value<int>(key, value);
+    else if (key == "bounds") {
+        std::istringstream stream(value);
+        for (double& bound : job.bounds) {
+            if (!(stream >> bound))
+                throw std::invalid_argument("Bounds need four numbers: " + value);
+        }
+        if (!(stream >> std::ws).eof())
+            throw std::invalid_argument("Bounds need four numbers: " + value);
+    }
+    else if (key == "mass_1") job.mass_1 = parse_value<double>(key, value);
+    else if (key == "mass_2") job.mass_2 = parse_value<double>(key, value);
+    else if (key == "length_1") job.length_1 = parse_value<double>(key, value);
+    else if (key == "length_2") job.length_2 = parse_value<double>(key, value);
+    else if (key == "integration_step") job.integration_step = parse_value<double>(key, value);
+    else if (key == "time_step") job.time_step = parse_value<double>(key, value);
+    else if (key == "max_time") job.max_time = parse_value<double>(key, value);
+    else if (key == "method") {
+        if (value == "rk4") job.method = IntegrationMethod::RK4;
+        else if (value == "dormand_prince") job.method = IntegrationMethod::DormandPrince;
+        else throw std::invalid_argument("Unknown method: " + value);
+    }
+    else if (key == "absolute_tolerance") job.absolute_tolerance = parse_value<double>(key, value);
+    else if (key == "relative_tolerance") job.relative_tolerance = parse_value<double>(key, value);
+    else if (key == "precision") {
+        if (value == "double") job.precision = Precision::Double;
+        else if (value == "mixed") job.precision = Precision::Mixed;
+        else if (value == "float") job.precision = Precision::Float;
+        else throw std::invalid_argument("Unknown precision: " + value);
+    }
+    else if (key == "accuracy_report") job.accuracy_report = parse_value<bool>(key, value);
+    else if (key == "fused_kernel") job.fused_kernel = parse_value<bool>(key, value);
+    else if (key == "time_batching") job.time_batching = parse_value<bool>(key, value);
+    else if (key == "flip_time_mode") job.flip_time_mode = parse_value<bool>(key, value);
+    else if (key == "adaptive_sampling") job.adaptive_sampling = parse_value<bool>(key, value);
+    else if (key == "coarse_cell_size") job.coarse_cell_size = parse_value<int>(key, value);
+    else if (key == "refinement_tolerance") job.refinement_tolerance = parse_value<double>(key, value);
+    else if (key == "point_symmetry") job.point_symmetry = parse_value<bool>(key, value);
+    else if (key == "flip_time_file") job.flip_time_file = value;
+    else if (key == "threads") job.threads = parse_value<int>(key, value);
+    else if (key == "tile_cache") job.tile_cache = value;
+    else if (key == "tile_cache_size") job.tile_cache_size = parse_value<int>(key, value);
+    else if (key == "tile_size") job.tile_size = parse_value<int>(key, value);
+    else if (key == "history_file") job.history_file = value;
+    else if (key == "image_folder") job.image_folder = value;
+    else if (key == "image_every") job.image_every = parse_value<int>(key, value);
+    else
+        throw std::invalid_argument("Unknown job key: " + key);
+}
+
+void read_job_line(JobDescription& job, const std::string& line)
+{
+    std::string text = trim(line);
+    if (text.empty() || text[0] == '#')
+        return;
+    std::size_t separator = text.find('=');
+    if (separator == std::string::npos)
+        throw std::invalid_argument("Expected key = value: " + text);
+    set_job_value(job, trim(text.substr(0, separator)), trim(text.substr(separator + 1)));
+}
+
+JobDescription read_job_file(const std::string& file_path)
+{
+    std::ifstream file(file_path);
+    if (!file)
+        throw std::ios_base::failure("Unable to open the file: " + file_path);
+
+    JobDescription job;
+    job.name = std::filesystem::path(file_path).stem().string();
+
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+        try {
+            read_job_line(job, line);
+        }
+        catch (const std::invalid_argument& exception) {
+            throw std::invalid_argument(file_path + ":" + std::to_string(line_number) + ": " + exception.what());
+        }
+    }
+    return job;
+}
+
+void validate_job(const JobDescription& job)
+{
+    check_positive("size_x", job.size_x);
+    check_positive("size_y", job.size_y);
+    for (double bound : job.bounds) {
+        if (!std::isfinite(bound))
+            throw std::invalid_argument("The bounds have to be finite.");
+    }
+    check_positive("mass_1", job.mass_1);
+    check_positive("mass_2", job.mass_2);
+    check_positive("length_1", job.length_1);
+    check_positive("length_2", job.length_2);
+    check_positive("integration_step", job.integration_step);
+    check_positive("time_step", job.time_step);
+    check_non_negative("max_time", job.max_time);
+    check_non_negative("absolute_tolerance", job.absolute_tolerance);
+    check_non_negative("relative_tolerance", job.relative_tolerance);
+    check_positive("coarse_cell_size", job.coarse_cell_size);
+    check_non_negative("refinement_tolerance", job.refinement_tolerance);
+    check_non_negative("threads", job.threads);
+    check_positive("tile_size", job.tile_size);
+    check_non_negative("tile_cache_size", job.tile_cache_size);
+    check_non_negative("image_every", job.image_every);
+    // Other integrations compute in mixed precision, the job would be labelled wrongly.
+    if (job.precision == Precision::Float
+        && (job.method != IntegrationMethod::RK4 || !job.fused_kernel || !job.time_batching))
+        throw std::invalid_argument("The float precision needs method = rk4, fused_kernel = true and time_batching = true.");
+}
@@ -0,0 +1,98 @@
+#include "Mapped_file.hpp"
+
+#include <ios>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(std::string file_path)
+: file_path(file_path)
+{
+#ifdef _WIN32
+    file_handle = CreateFileA(file_path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        throw std::ios_base::failure("Unable to open the file: " + file_path);
+    }
+#else
+    descriptor = open(file_path.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        throw std::ios_base::failure("Unable to open the file: " + file_path);
+    }
+#endif
+    remap();
+}
+
+MappedFile::~MappedFile()
+{
+    unmap();
+#ifdef _WIN32
+    CloseHandle(file_handle);
+#else
+    close(descriptor);
+#endif
+}
+
+void MappedFile::unmap()
+{
+#ifdef _WIN32
+    if (address) {
+        UnmapViewOfFile(address);
+    }
+    if (mapping_handle) {
+        CloseHandle(mapping_handle);
+    }
+    mapping_handle = nullptr;
+#else
+    if (address) {
+        munmap(const_cast<char*>(address), length);
+    }
+#endif
+    address = nullptr;
+    length = 0;
+}
+
+void MappedFile::remap()
+{
+    unmap();
+
+#ifdef _WIN32
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file_handle, &file_size)) {
+        throw std::ios_base::failure("Unable to get the size of the file: " + file_path);
+    }
+    if (file_size.QuadPart == 0) {
+        return;
+    }
+    mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping_handle) {
+        throw std::ios_base::failure("Unable to map the file: " + file_path);
+    }
+    address = static_cast<const char*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+    if (!address) {
+        throw std::ios_base::failure("Unable to map the file: " + file_path);
+    }
+    length = file_size.QuadPart;
+#else
+    struct stat file_status;
+    if (fstat(descriptor, &file_status) != 0) {
+        throw std::ios_base::failure("Unable to get the size of the file: " + file_path);
+    }
+    if (file_status.st_size == 0) {
+        return;
+    }
+    void* mapping = mmap(nullptr, file_status.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+    if (mapping == MAP_FAILED) {
+        throw std::ios_base::failure("Unable to map the file: " + file_path);
+    }
+    address = static_cast<const char*>(mapping);
+    length = file_status.st_size;
+#endif
+}
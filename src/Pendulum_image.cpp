@@ -0,0 +1,83 @@
+#include "Pendulum_image.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+double normalize_angle(double angle)
+{
+    return angle - floor(angle/(2*PI))*2*PI;
+}
+
+namespace
+{
+    void set_quadrant_colour(double phi_1, double phi_2, unsigned char* pixel)
+    {
+        pixel[0] = 0;    // R
+        pixel[1] = 0;    // G
+        pixel[2] = 0;    // B
+        if (normalize_angle(phi_1) <= PI && normalize_angle(phi_2) <= PI) {
+            pixel[0] = 255;
+            pixel[1] = 255;
+        }
+        else if (normalize_angle(phi_1) <= PI && normalize_angle(phi_2) > PI) {
+            pixel[0] = 255;
+        }
+        else if (normalize_angle(phi_1) > PI && normalize_angle(phi_2) <= PI) {
+            pixel[2] = 255;
+        }
+        else {
+            pixel[1] = 255;
+        }
+    }
+}
+
+void render_quadrant_image(PendulumSystem& system, int number, std::vector<unsigned char>& pixels)
+{
+    int size_x = system.get_size()[0];
+    int size_y = system.get_size()[1];
+    pixels.resize(3 * size_x * size_y);
+    for (int j = 0; j < size_y; j++) {
+        for (int i = 0; i < size_x; i++) {
+            int index = 3*((size_y - 1 - j)*size_x + i);
+            set_quadrant_colour(system.get_phi_1(i, j, number), system.get_phi_2(i, j, number), &pixels[index]);
+        }
+    }
+}
+
+void render_quadrant_image(PendulumSystem& system, const std::vector<double>& state, std::vector<unsigned char>& pixels)
+{
+    int size_x = system.get_size()[0];
+    int size_y = system.get_size()[1];
+    int pendulum_count = system.get_pendulum_count();
+    pixels.resize(3 * size_x * size_y);
+    for (int j = 0; j < size_y; j++) {
+        for (int i = 0; i < size_x; i++) {
+            int index = 3*((size_y - 1 - j)*size_x + i);
+            set_quadrant_colour(state[j*size_x + i], state[pendulum_count + j*size_x + i], &pixels[index]);
+        }
+    }
+}
+
+void render_flip_time_image(PendulumSystem& system, double time, std::vector<unsigned char>& pixels)
+{
+    const double stops[4][3] = {{255, 255, 255}, {255, 140, 0}, {128, 0, 128}, {0, 0, 96}};
+    int size_x = system.get_size()[0];
+    int size_y = system.get_size()[1];
+    pixels.resize(3 * size_x * size_y);
+    for (int j = 0; j < size_y; j++) {
+        for (int i = 0; i < size_x; i++) {
+            unsigned char* pixel = &pixels[3*((size_y - 1 - j)*size_x + i)];
+            double flip_time = system.get_flip_time(i, j);
+            if (flip_time == PendulumSystem::flip_not_yet || flip_time > time) {
+                pixel[0] = pixel[1] = pixel[2] = 0;
+                continue;
+            }
+            double position = time > 0 ? 3 * std::log1p(flip_time) / std::log1p(time) : 0;
+            int stop = std::min(2, static_cast<int>(position));
+            double weight = position - stop;
+            for (int c = 0; c < 3; c++) {
+                pixel[c] = static_cast<unsigned char>(stops[stop][c] + weight * (stops[stop + 1][c] - stops[stop][c]));
+            }
+        }
+    }
+}
@@ -0,0 +1,355 @@
+#include "Pendulum_kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace
+{
+    // The constants and the accelerations are computed in T, float for the float kernels.
+    template <class T, PendulumForm form>
+    struct ScalarPendulumConstants
+    {
+        T minus_m12_g_l1;
+        T minus_m2_g_l2;
+        T m2_l1_l2;
+        T b;
+        T e;
+
+        ScalarPendulumConstants(const PendulumParameters& parameters)
+        : minus_m12_g_l1(-(parameters.mass_1 + parameters.mass_2)*parameters.g*parameters.length_1),
+        minus_m2_g_l2(-parameters.mass_2*parameters.g*parameters.length_2),
+        m2_l1_l2(parameters.mass_2*parameters.length_1*parameters.length_2),
+        b((parameters.mass_1 + parameters.mass_2)*parameters.length_1*parameters.length_1),
+        e(parameters.mass_2*parameters.length_2*parameters.length_2)
+        {
+        }
+    };
+
+    // Same as SimdPendulumConstants of equal arms.
+    template <class T>
+    struct ScalarPendulumConstants<T, PendulumForm::EqualArms>
+    {
+        T minus_2_g_l;
+        T minus_g_l;
+
+        ScalarPendulumConstants(const PendulumParameters& parameters)
+        : minus_2_g_l(-2*parameters.g/parameters.length_1),
+        minus_g_l(-parameters.g/parameters.length_1)
+        {
+        }
+    };
+
+    template <class T, PendulumForm form>
+    inline void scalar_accelerations(const ScalarPendulumConstants<T, form>& constants, T phi_1, T phi_2,
+                                     T der_phi_1, T der_phi_2, T& acc_1, T& acc_2)
+    {
+        T sin_12 = std::sin(phi_1 - phi_2);
+        T cos_12 = std::cos(phi_1 - phi_2);
+
+        if constexpr (form == PendulumForm::EqualArms) {
+            T a = constants.minus_2_g_l*std::sin(phi_1) - der_phi_2*der_phi_2*sin_12;
+            T d = constants.minus_g_l*std::sin(phi_2) + der_phi_1*der_phi_1*sin_12;
+            T half_c = T(0.5)*cos_12;
+
+            acc_2 = (d - a*half_c)/(T(1) - cos_12*half_c);
+            acc_1 = T(0.5)*a - half_c*acc_2;
+        }
+        else {
+            T a = constants.minus_m12_g_l1*std::sin(phi_1) - constants.m2_l1_l2*der_phi_2*der_phi_2*sin_12;
+            T c = constants.m2_l1_l2*cos_12;
+            T d = constants.minus_m2_g_l2*std::sin(phi_2) + constants.m2_l1_l2*der_phi_1*der_phi_1*sin_12;
+
+            acc_2 = (d - a*c/constants.b)/(constants.e - c*c/constants.b);
+            acc_1 = a/constants.b - c/constants.b*acc_2;
+        }
+    }
+
+    template <class T, PendulumForm form>
+    void scalar_rhs(const PendulumParameters& parameters, const double* state, double* right_hand_side, int stride, int count)
+    {
+        const double* phi_1 = state;
+        const double* phi_2 = state + stride;
+        const double* der_phi_1 = state + 2*stride;
+        const double* der_phi_2 = state + 3*stride;
+        const ScalarPendulumConstants<T, form> constants(parameters);
+
+        for(int n = 0; n < count; n++){
+            right_hand_side[n] = der_phi_1[n];
+            right_hand_side[stride + n] = der_phi_2[n];
+            T acc_1, acc_2;
+            scalar_accelerations<T, form>(constants, phi_1[n], phi_2[n], der_phi_1[n], der_phi_2[n], acc_1, acc_2);
+            right_hand_side[2*stride + n] = acc_1;
+            right_hand_side[3*stride + n] = acc_2;
+        }
+    }
+
+    // Same operations as RungeKutta::integrate_tile on scalar_rhs<A>, with the state and the
+    // stages kept in T.
+    template <class T, class A, PendulumForm form>
+    void scalar_rk4(const PendulumParameters& parameters, double* state, int stride, int count, double step, int substeps)
+    {
+        const ScalarPendulumConstants<A, form> constants(parameters);
+        const T half_step = 1.0/2 * step;
+        const T full_step = step;
+        const T sixth_step = 1.0/6 * step;
+        for(int n = 0; n < count; n++){
+            T y[4] = {T(state[n]), T(state[stride + n]), T(state[2*stride + n]), T(state[3*stride + n])};
+            for(int substep = 0; substep < substeps; substep++){
+                T k[4][4];
+                T aux[4];
+                for(int stage = 0; stage < 4; stage++){
+                    if(stage > 0){
+                        T factor = stage < 3 ? half_step : full_step;
+                        for(int v = 0; v < 4; v++){
+                            aux[v] = y[v] + factor * k[stage - 1][v];
+                        }
+                    }
+                    const T* input = stage == 0 ? y : aux;
+                    A acc_1, acc_2;
+                    scalar_accelerations<A, form>(constants, input[0], input[1], input[2], input[3], acc_1, acc_2);
+                    k[stage][0] = input[2];
+                    k[stage][1] = input[3];
+                    k[stage][2] = acc_1;
+                    k[stage][3] = acc_2;
+                }
+                for(int v = 0; v < 4; v++){
+                    y[v] += sixth_step * (k[0][v] + 2*k[1][v] + 2*k[2][v] + k[3][v]);
+                }
+            }
+            for(int v = 0; v < 4; v++){
+                state[v*stride + n] = y[v];
+            }
+        }
+    }
+}
+
+template <PendulumForm form>
+void pendulum_rhs_scalar(const PendulumParameters& parameters, const double* state, double* right_hand_side, int stride, int count)
+{
+    scalar_rhs<double, form>(parameters, state, right_hand_side, stride, count);
+}
+
+template <PendulumForm form>
+void pendulum_rhs_float_scalar(const PendulumParameters& parameters, const double* state, double* right_hand_side, int stride, int count)
+{
+    scalar_rhs<float, form>(parameters, state, right_hand_side, stride, count);
+}
+
+template <PendulumForm form>
+void pendulum_rk4_scalar(const PendulumParameters& parameters, double* state, int stride, int count, double step, int substeps)
+{
+    scalar_rk4<double, double, form>(parameters, state, stride, count, step, substeps);
+}
+
+template <PendulumForm form>
+void pendulum_rk4_mixed_scalar(const PendulumParameters& parameters, double* state, int stride, int count, double step, int substeps)
+{
+    scalar_rk4<double, float, form>(parameters, state, stride, count, step, substeps);
+}
+
+template <PendulumForm form>
+void pendulum_rk4_float_scalar(const PendulumParameters& parameters, double* state, int stride, int count, double step, int substeps)
+{
+    scalar_rk4<float, float, form>(parameters, state, stride, count, step, substeps);
+}
+
+template void pendulum_rhs_scalar<PendulumForm::General>(const PendulumParameters&, const double*, double*, int, int);
+template void pendulum_rhs_float_scalar<PendulumForm::General>(const PendulumParameters&, const double*, double*, int, int);
+template void pendulum_rk4_scalar<PendulumForm::General>(const PendulumParameters&, double*, int, int, double, int);
+template void pendulum_rk4_mixed_scalar<PendulumForm::General>(const PendulumParameters&, double*, int, int, double, int);
+template void pendulum_rk4_float_scalar<PendulumForm::General>(const PendulumParameters&, double*, int, int, double, int);
+
+template void pendulum_rhs_scalar<PendulumForm::EqualArms>(const PendulumParameters&, const double*, double*, int, int);
+template void pendulum_rhs_float_scalar<PendulumForm::EqualArms>(const PendulumParameters&, const double*, double*, int, int);
+template void pendulum_rk4_scalar<PendulumForm::EqualArms>(const PendulumParameters&, double*, int, int, double, int);
+template void pendulum_rk4_mixed_scalar<PendulumForm::EqualArms>(const PendulumParameters&, double*, int, int, double, int);
+template void pendulum_rk4_float_scalar<PendulumForm::EqualArms>(const PendulumParameters&, double*, int, int, double, int);
+
+PendulumForm get_pendulum_form(const PendulumParameters& parameters)
+{
+    if (parameters.mass_1 == parameters.mass_2 && parameters.length_1 == parameters.length_2)
+        return PendulumForm::EqualArms;
+    return PendulumForm::General;
+}
+
+InstructionSet detect_instruction_set()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return InstructionSet::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return InstructionSet::AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return InstructionSet::SSE2;
+    }
+#endif
+    return InstructionSet::Scalar;
+}
+
+InstructionSet get_default_instruction_set()
+{
+    static InstructionSet instruction_set = []() {
+        InstructionSet detected = detect_instruction_set();
+        double error = measure_rhs_kernel_ulp_error(detected, 4096);
+        if (error > rhs_kernel_ulp_bound) {
+            std::cerr << "The " << get_instruction_set_name(detected) << " kernel differs from the scalar one by "
+                      << error << " ulp, falling back to the scalar kernel." << std::endl;
+            return InstructionSet::Scalar;
+        }
+        return detected;
+    }();
+    return instruction_set;
+}
+
+std::string get_instruction_set_name(InstructionSet instruction_set)
+{
+    switch (instruction_set) {
+        case InstructionSet::SSE2:
+            return "SSE2";
+        case InstructionSet::AVX2:
+            return "AVX2";
+        case InstructionSet::AVX512:
+            return "AVX-512";
+        default:
+            return "scalar";
+    }
+}
+
+std::string get_precision_name(Precision precision)
+{
+    switch (precision) {
+        case Precision::Mixed:
+            return "mixed";
+        case Precision::Float:
+            return "float";
+        default:
+            return "double";
+    }
+}
+
+namespace
+{
+    template <PendulumForm form>
+    PendulumRhsKernel select_rhs_kernel(InstructionSet instruction_set, Precision precision)
+    {
+        if (precision != Precision::Double) {
+            switch (instruction_set) {
+                case InstructionSet::SSE2:
+                    return pendulum_rhs_float_sse2<form>;
+                case InstructionSet::AVX2:
+                    return pendulum_rhs_float_avx2<form>;
+                case InstructionSet::AVX512:
+                    return pendulum_rhs_float_avx512<form>;
+                default:
+                    return pendulum_rhs_float_scalar<form>;
+            }
+        }
+        switch (instruction_set) {
+            case InstructionSet::SSE2:
+                return pendulum_rhs_sse2<form>;
+            case InstructionSet::AVX2:
+                return pendulum_rhs_avx2<form>;
+            case InstructionSet::AVX512:
+                return pendulum_rhs_avx512<form>;
+            default:
+                return pendulum_rhs_scalar<form>;
+        }
+    }
+
+    template <PendulumForm form>
+    PendulumRk4Kernel select_rk4_kernel(InstructionSet instruction_set, Precision precision)
+    {
+        if (precision == Precision::Mixed) {
+            switch (instruction_set) {
+                case InstructionSet::SSE2:
+                    return pendulum_rk4_mixed_sse2<form>;
+                case InstructionSet::AVX2:
+                    return pendulum_rk4_mixed_avx2<form>;
+                case InstructionSet::AVX512:
+                    return pendulum_rk4_mixed_avx512<form>;
+                default:
+                    return pendulum_rk4_mixed_scalar<form>;
+            }
+        }
+        if (precision == Precision::Float) {
+            switch (instruction_set) {
+                case InstructionSet::SSE2:
+                    return pendulum_rk4_float_sse2<form>;
+                case InstructionSet::AVX2:
+                    return pendulum_rk4_float_avx2<form>;
+                case InstructionSet::AVX512:
+                    return pendulum_rk4_float_avx512<form>;
+                default:
+                    return pendulum_rk4_float_scalar<form>;
+            }
+        }
+        switch (instruction_set) {
+            case InstructionSet::SSE2:
+                return pendulum_rk4_sse2<form>;
+            case InstructionSet::AVX2:
+                return pendulum_rk4_avx2<form>;
+            case InstructionSet::AVX512:
+                return pendulum_rk4_avx512<form>;
+            default:
+                return pendulum_rk4_scalar<form>;
+        }
+    }
+}
+
+PendulumRhsKernel get_rhs_kernel(InstructionSet instruction_set, Precision precision, PendulumForm form)
+{
+    if (form == PendulumForm::EqualArms)
+        return select_rhs_kernel<PendulumForm::EqualArms>(instruction_set, precision);
+    return select_rhs_kernel<PendulumForm::General>(instruction_set, precision);
+}
+
+PendulumRk4Kernel get_rk4_kernel(InstructionSet instruction_set, Precision precision, PendulumForm form)
+{
+    if (form == PendulumForm::EqualArms)
+        return select_rk4_kernel<PendulumForm::EqualArms>(instruction_set, precision);
+    return select_rk4_kernel<PendulumForm::General>(instruction_set, precision);
+}
+
+double measure_rhs_kernel_ulp_error(InstructionSet instruction_set, int samples)
+{
+    PendulumParameters parameters = {1.0, 1.5, 1.0, 0.75, 9.81};
+
+    std::mt19937_64 generator(12345);
+    std::uniform_real_distribution<double> angle(-20.0, 20.0);
+    std::uniform_real_distribution<double> velocity(-15.0, 15.0);
+
+    std::vector<double> state(4*samples);
+    for (int n = 0; n < samples; n++) {
+        state[n] = angle(generator);
+        state[samples + n] = angle(generator);
+        state[2*samples + n] = velocity(generator);
+        state[3*samples + n] = velocity(generator);
+    }
+
+    std::vector<double> reference(4*samples);
+    std::vector<double> result(4*samples);
+    pendulum_rhs_scalar<PendulumForm::General>(parameters, state.data(), reference.data(), samples, samples);
+    get_rhs_kernel(instruction_set)(parameters, state.data(), result.data(), samples, samples);
+
+    double max_error = 0;
+    for (int i = 0; i < 4*samples; i++) {
+        int n = i % samples;
+        double term_scale = parameters.g + state[2*samples + n]*state[2*samples + n]
+                                         + state[3*samples + n]*state[3*samples + n];
+        double scale = std::max(std::abs(reference[i]), term_scale);
+        double ulp = std::nextafter(scale, std::numeric_limits<double>::infinity()) - scale;
+        double error = std::abs(result[i] - reference[i])/ulp;
+        if (std::isnan(error)) {
+            return std::numeric_limits<double>::infinity();
+        }
+        max_error = std::max(max_error, error);
+    }
+    return max_error;
+}
@@ -0,0 +1,102 @@
+#include "Pendulum_simd.hpp"
+
+#include <immintrin.h>
+
+namespace
+{
+    struct AVX2Vector
+    {
+        using value = double;
+        using reg = __m256d;
+        using mask = __m256d;
+        static constexpr int width = 4;
+
+        static reg set1(double value) { return _mm256_set1_pd(value); }
+        static reg load(const double* address) { return _mm256_loadu_pd(address); }
+        static void store(double* address, reg value) { _mm256_storeu_pd(address, value); }
+
+        static reg add(reg a, reg b) { return _mm256_add_pd(a, b); }
+        static reg sub(reg a, reg b) { return _mm256_sub_pd(a, b); }
+        static reg mul(reg a, reg b) { return _mm256_mul_pd(a, b); }
+        static reg div(reg a, reg b) { return _mm256_div_pd(a, b); }
+        static reg floor(reg a) { return _mm256_floor_pd(a); }
+
+        static mask less(reg a, reg b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+        static mask equal(reg a, reg b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+        static mask greater_equal(reg a, reg b) { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+        static mask mask_or(mask a, mask b) { return _mm256_or_pd(a, b); }
+        static reg select(mask m, reg if_true, reg if_false) { return _mm256_blendv_pd(if_false, if_true, m); }
+    };
+
+    struct AVX2FloatVector
+    {
+        using value = float;
+        using reg = __m256;
+        using mask = __m256;
+        using double_vector = AVX2Vector;
+        static constexpr int width = 8;
+
+        static reg set1(float value) { return _mm256_set1_ps(value); }
+        static reg narrow(__m256d low, __m256d high) {
+            return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(low)), _mm256_cvtpd_ps(high), 1);
+        }
+        static void widen(reg a, __m256d& low, __m256d& high) {
+            low = _mm256_cvtps_pd(_mm256_castps256_ps128(a));
+            high = _mm256_cvtps_pd(_mm256_extractf128_ps(a, 1));
+        }
+
+        static reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+        static reg sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+        static reg mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+        static reg div(reg a, reg b) { return _mm256_div_ps(a, b); }
+        static reg floor(reg a) { return _mm256_floor_ps(a); }
+
+        static mask less(reg a, reg b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+        static mask equal(reg a, reg b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+        static mask greater_equal(reg a, reg b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+        static mask mask_or(mask a, mask b) { return _mm256_or_ps(a, b); }
+        static reg select(mask m, reg if_true, reg if_false) { return _mm256_blendv_ps(if_false, if_true, m); }
+    };
+}
+
+template <PendulumForm form>
+void pendulum_rhs_avx2(const PendulumParameters& parameters, const double* state, double* right_hand_side, int stride, int count)
+{
+    simd_pendulum_rhs<AVX2Vector, form>(parameters, state, right_hand_side, stride, count);
+}
+
+template <PendulumForm form>
+void pendulum_rk4_avx2(const PendulumParameters& parameters, double* state, int stride, int count, double step, int substeps)
+{
+    simd_pendulum_rk4<AVX2Vector, form>(parameters, state, stride, count, step, substeps);
+}
+
+template <PendulumForm form>
+void pendulum_rhs_float_avx2(const PendulumParameters& parameters, const double* state, double* right_hand_side, int stride, int count)
+{
+    simd_pendulum_rhs<AVX2FloatVector, form>(parameters, state, right_hand_side, stride, count);
+}
+
+template <PendulumForm form>
+void pendulum_rk4_mixed_avx2(const PendulumParameters& parameters, double* state, int stride, int count, double step, int substeps)
+{
+    simd_pendulum_rk4_mixed<AVX2FloatVector, form>(parameters, state, stride, count, step, substeps);
+}
+
+template <PendulumForm form>
+void pendulum_rk4_float_avx2(const PendulumParameters& parameters, double* state, int stride, int count, double step, int substeps)
+{
+    simd_pendulum_rk4<AVX2FloatVector, form>(parameters, state, stride, count, step, substeps);
+}
+
+template void pendulum_rhs_avx2<PendulumForm::General>(const PendulumParameters&, const double*, double*, int, int);
+template void pendulum_rk4_avx2<PendulumForm::General>(const PendulumParameters&, double*, int, int, double, int);
+template void pendulum_rhs_float_avx2<PendulumForm::General>(const PendulumParameters&, const double*, double*, int, int);
+template void pendulum_rk4_mixed_avx2<PendulumForm::General>(const PendulumParameters&, double*, int, int, double, int);
+template void pendulum_rk4_float_avx2<PendulumForm::General>(const PendulumParameters&, double*, int, int, double, int);
+
+template void pendulum_rhs_avx2<PendulumForm::EqualArms>(const PendulumParameters&, const double*, double*, int, int);
+template void pendulum_rk4_avx2<PendulumForm::EqualArms>(const PendulumParameters&, double*, int, int, double, int);
+template void pendulum_rhs_float_avx2<PendulumForm::EqualArms>(const PendulumParameters&, const double*, double*, int, int);
+template void pendulum_rk4_mixed_avx2<PendulumForm::EqualArms>(const PendulumParameters&, double*, int, int, double, int);
+template void pendulum_rk4_float_avx2<PendulumForm::EqualArms>(const PendulumParameters&, double*, int, int, double, int);
@@ -0,0 +1,104 @@
+#include "Pendulum_simd.hpp"
+
+#include <immintrin.h>
+
+namespace
+{
+    struct AVX512Vector
+    {
+        using value = double;
+        using reg = __m512d;
+        using mask = __mmask8;
+        static constexpr int width = 8;
+
+        static reg set1(double value) { return _mm512_set1_pd(value); }
+        static reg load(const double* address) { return _mm512_loadu_pd(address); }
+        static void store(double* address, reg value) { _mm512_storeu_pd(address, value); }
+
+        static reg add(reg a, reg b) { return _mm512_add_pd(a, b); }
+        static reg sub(reg a, reg b) { return _mm512_sub_pd(a, b); }
+        static reg mul(reg a, reg b) { return _mm512_mul_pd(a, b); }
+        static reg div(reg a, reg b) { return _mm512_div_pd(a, b); }
+        static reg floor(reg a) { return _mm512_roundscale_pd(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+
+        static mask less(reg a, reg b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+        static mask equal(reg a, reg b) { return _mm512_cmp_pd_mask(a, b, _CMP_EQ_OQ); }
+        static mask greater_equal(reg a, reg b) { return _mm512_cmp_pd_mask(a, b, _CMP_GE_OQ); }
+        static mask mask_or(mask a, mask b) { return a | b; }
+        static reg select(mask m, reg if_true, reg if_false) { return _mm512_mask_blend_pd(m, if_false, if_true); }
+    };
+
+    struct AVX512FloatVector
+    {
+        using value = float;
+        using reg = __m512;
+        using mask = __mmask16;
+        using double_vector = AVX512Vector;
+        static constexpr int width = 16;
+
+        static reg set1(float value) { return _mm512_set1_ps(value); }
+        // Joined as doubles, AVX-512F alone cannot insert eight floats.
+        static reg narrow(__m512d low, __m512d high) {
+            __m512d joined = _mm512_castps_pd(_mm512_castps256_ps512(_mm512_cvtpd_ps(low)));
+            return _mm512_castpd_ps(_mm512_insertf64x4(joined, _mm256_castps_pd(_mm512_cvtpd_ps(high)), 1));
+        }
+        static void widen(reg a, __m512d& low, __m512d& high) {
+            low = _mm512_cvtps_pd(_mm512_castps512_ps256(a));
+            high = _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(a), 1)));
+        }
+
+        static reg add(reg a, reg b) { return _mm512_add_ps(a, b); }
+        static reg sub(reg a, reg b) { return _mm512_sub_ps(a, b); }
+        static reg mul(reg a, reg b) { return _mm512_mul_ps(a, b); }
+        static reg div(reg a, reg b) { return _mm512_div_ps(a, b); }
+        static reg floor(reg a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+
+        static mask less(reg a, reg b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+        static mask equal(reg a, reg b) { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+        static mask greater_equal(reg a, reg b) { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+        static mask mask_or(mask a, mask b) { return a | b; }
+        static reg select(mask m, reg if_true, reg if_false) { return _mm512_mask_blend_ps(m, if_false, if_true); }
+    };
+}
+
+template <PendulumForm form>
+void pendulum_rhs_avx512(const PendulumParameters& parameters, const double* state, double* right_hand_side, int stride, int count)
+{
+    simd_pendulum_rhs<AVX512Vector, form>(parameters, state, right_hand_side, stride, count);
+}
+
+template <PendulumForm form>
+void pendulum_rk4_avx512(const PendulumParameters& parameters, double* state, int stride, int count, double step, int substeps)
+{
+    simd_pendulum_rk4<AVX512Vector, form>(parameters, state, stride, count, step, substeps);
+}
+
+template <PendulumForm form>
+void pendulum_rhs_float_avx512(const PendulumParameters& parameters, const double* state, double* right_hand_side, int stride, int count)
+{
+    simd_pendulum_rhs<AVX512FloatVector, form>(parameters, state, right_hand_side, stride, count);
+}
+
+template <PendulumForm form>
+void pendulum_rk4_mixed_avx512(const PendulumParameters& parameters, double* state, int stride, int count, double step, int substeps)
+{
+    simd_pendulum_rk4_mixed<AVX512FloatVector, form>(parameters, state, stride, count, step, substeps);
+}
+
+template <PendulumForm form>
+void pendulum_rk4_float_avx512(const PendulumParameters& parameters, double* state, int stride, int count, double step, int substeps)
+{
+    simd_pendulum_rk4<AVX512FloatVector, form>(parameters, state, stride, count, step, substeps);
+}
+
+template void pendulum_rhs_avx512<PendulumForm::General>(const PendulumParameters&, const double*, double*, int, int);
+template void pendulum_rk4_avx512<PendulumForm::General>(const PendulumParameters&, double*, int, int, double, int);
+template void pendulum_rhs_float_avx512<PendulumForm::General>(const PendulumParameters&, const double*, double*, int, int);
+template void pendulum_rk4_mixed_avx512<PendulumForm::General>(const PendulumParameters&, double*, int, int, double, int);
+template void pendulum_rk4_float_avx512<PendulumForm::General>(const PendulumParameters&, double*, int, int, double, int);
+
+template void pendulum_rhs_avx512<PendulumForm::EqualArms>(const PendulumParameters&, const double*, double*, int, int);
+template void pendulum_rk4_avx512<PendulumForm::EqualArms>(const PendulumParameters&, double*, int, int, double, int);
+template void pendulum_rhs_float_avx512<PendulumForm::EqualArms>(const PendulumParameters&, const double*, double*, int, int);
+template void pendulum_rk4_mixed_avx512<PendulumForm::EqualArms>(const PendulumParameters&, double*, int, int, double, int);
+template void pendulum_rk4_float_avx512<PendulumForm::EqualArms>(const PendulumParameters&, double*, int, int, double, int);
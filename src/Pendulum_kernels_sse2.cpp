@@ -0,0 +1,106 @@
+#include "Pendulum_simd.hpp"
+
+#include <immintrin.h>
+
+namespace
+{
+    struct SSE2Vector
+    {
+        using value = double;
+        using reg = __m128d;
+        using mask = __m128d;
+        static constexpr int width = 2;
+
+        static reg set1(double value) { return _mm_set1_pd(value); }
+        static reg load(const double* address) { return _mm_loadu_pd(address); }
+        static void store(double* address, reg value) { _mm_storeu_pd(address, value); }
+
+        static reg add(reg a, reg b) { return _mm_add_pd(a, b); }
+        static reg sub(reg a, reg b) { return _mm_sub_pd(a, b); }
+        static reg mul(reg a, reg b) { return _mm_mul_pd(a, b); }
+        static reg div(reg a, reg b) { return _mm_div_pd(a, b); }
+
+        // SSE2 has no rounding instruction; the arguments are non-negative and below 2^31.
+        static reg floor(reg a) { return _mm_cvtepi32_pd(_mm_cvttpd_epi32(a)); }
+
+        static mask less(reg a, reg b) { return _mm_cmplt_pd(a, b); }
+        static mask equal(reg a, reg b) { return _mm_cmpeq_pd(a, b); }
+        static mask greater_equal(reg a, reg b) { return _mm_cmpge_pd(a, b); }
+        static mask mask_or(mask a, mask b) { return _mm_or_pd(a, b); }
+        static reg select(mask m, reg if_true, reg if_false) {
+            return _mm_or_pd(_mm_and_pd(m, if_true), _mm_andnot_pd(m, if_false));
+        }
+    };
+
+    struct SSE2FloatVector
+    {
+        using value = float;
+        using reg = __m128;
+        using mask = __m128;
+        using double_vector = SSE2Vector;
+        static constexpr int width = 4;
+
+        static reg set1(float value) { return _mm_set1_ps(value); }
+        static reg narrow(__m128d low, __m128d high) { return _mm_movelh_ps(_mm_cvtpd_ps(low), _mm_cvtpd_ps(high)); }
+        static void widen(reg a, __m128d& low, __m128d& high) {
+            low = _mm_cvtps_pd(a);
+            high = _mm_cvtps_pd(_mm_movehl_ps(a, a));
+        }
+
+        static reg add(reg a, reg b) { return _mm_add_ps(a, b); }
+        static reg sub(reg a, reg b) { return _mm_sub_ps(a, b); }
+        static reg mul(reg a, reg b) { return _mm_mul_ps(a, b); }
+        static reg div(reg a, reg b) { return _mm_div_ps(a, b); }
+        static reg floor(reg a) { return _mm_cvtepi32_ps(_mm_cvttps_epi32(a)); }
+
+        static mask less(reg a, reg b) { return _mm_cmplt_ps(a, b); }
+        static mask equal(reg a, reg b) { return _mm_cmpeq_ps(a, b); }
+        static mask greater_equal(reg a, reg b) { return _mm_cmpge_ps(a, b); }
+        static mask mask_or(mask a, mask b) { return _mm_or_ps(a, b); }
+        static reg select(mask m, reg if_true, reg if_false) {
+            return _mm_or_ps(_mm_and_ps(m, if_true), _mm_andnot_ps(m, if_false));
+        }
+    };
+}
+
+template <PendulumForm form>
+void pendulum_rhs_sse2(const PendulumParameters& parameters, const double* state, double* right_hand_side, int stride, int count)
+{
+    simd_pendulum_rhs<SSE2Vector, form>(parameters, state, right_hand_side, stride, count);
+}
+
+template <PendulumForm form>
+void pendulum_rk4_sse2(const PendulumParameters& parameters, double* state, int stride, int count, double step, int substeps)
+{
+    simd_pendulum_rk4<SSE2Vector, form>(parameters, state, stride, count, step, substeps);
+}
+
+template <PendulumForm form>
+void pendulum_rhs_float_sse2(const PendulumParameters& parameters, const double* state, double* right_hand_side, int stride, int count)
+{
+    simd_pendulum_rhs<SSE2FloatVector, form>(parameters, state, right_hand_side, stride, count);
+}
+
+template <PendulumForm form>
+void pendulum_rk4_mixed_sse2(const PendulumParameters& parameters, double* state, int stride, int count, double step, int substeps)
+{
+    simd_pendulum_rk4_mixed<SSE2FloatVector, form>(parameters, state, stride, count, step, substeps);
+}
+
+template <PendulumForm form>
+void pendulum_rk4_float_sse2(const PendulumParameters& parameters, double* state, int stride, int count, double step, int substeps)
+{
+    simd_pendulum_rk4<SSE2FloatVector, form>(parameters, state, stride, count, step, substeps);
+}
+
+template void pendulum_rhs_sse2<PendulumForm::General>(const PendulumParameters&, const double*, double*, int, int);
+template void pendulum_rk4_sse2<PendulumForm::General>(const PendulumParameters&, double*, int, int, double, int);
+template void pendulum_rhs_float_sse2<PendulumForm::General>(const PendulumParameters&, const double*, double*, int, int);
+template void pendulum_rk4_mixed_sse2<PendulumForm::General>(const PendulumParameters&, double*, int, int, double, int);
+template void pendulum_rk4_float_sse2<PendulumForm::General>(const PendulumParameters&, double*, int, int, double, int);
+
+template void pendulum_rhs_sse2<PendulumForm::EqualArms>(const PendulumParameters&, const double*, double*, int, int);
+template void pendulum_rk4_sse2<PendulumForm::EqualArms>(const PendulumParameters&, double*, int, int, double, int);
+template void pendulum_rhs_float_sse2<PendulumForm::EqualArms>(const PendulumParameters&, const double*, double*, int, int);
+template void pendulum_rk4_mixed_sse2<PendulumForm::EqualArms>(const PendulumParameters&, double*, int, int, double, int);
+template void pendulum_rk4_float_sse2<PendulumForm::EqualArms>(const PendulumParameters&, double*, int, int, double, int);
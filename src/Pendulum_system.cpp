@@ -1,44 +1,401 @@
 #include "Pendulum_system.hpp"
 
-void PendulumSystem::get_right_hand_side(const double time, const std::vector<double>& state, std::vector<double>& right_hand_side)
+PendulumSystem::PendulumSystem(std::shared_ptr<FileFrameSink> history)
+: PendulumSystem(history->get_header().size_x,
+                 history->get_header().size_y,
+                 history->get_header().bounds,
+                 history->get_header().mass_1,
+                 history->get_header().mass_2,
+                 history->get_header().length_1,
+                 history->get_header().length_2)
 {
-    float g = 9.81;
-    double a, b, c, d, e, f;
-    for(int i = 0; i < this->size_x; i++){
-        for(int j = 0; j < this->size_y; j++){
-            a = -(mass_1 + mass_2)*g*length_1*sin(get_phi_1(i, j))
-                - mass_2*length_1*length_2*pow(get_der_phi_2(i, j), 2)*sin(get_phi_1(i, j) - get_phi_2(i, j));
-            b = (mass_1 + mass_2)*length_1*length_1;
-            c = mass_2*length_1*length_2*cos(get_phi_1(i, j) - get_phi_2(i, j));
-            d = -mass_2*g*length_2*sin(get_phi_2(i, j))
-                + mass_2*length_1*length_2*pow(get_der_phi_1(i, j), 2)*sin(get_phi_1(i, j) - get_phi_2(i, j));
-            e = mass_2*length_2*length_2;
-            f = mass_2*length_1*length_2*cos(get_phi_1(i, j) - get_phi_2(i, j));
+    this->time_step = history->get_header().time_step;
+    this->frame_sink = history;
+    if (history->get_header().value_size == sizeof(float)) {
+        this->set_precision(Precision::Float);
+    }
 
-            right_hand_side[(j*size_x + i)*4] = get_der_phi_1(i, j);
-            right_hand_side[(j*size_x + i)*4 + 1] = get_der_phi_2(i, j);
-            right_hand_side[(j*size_x + i)*4 + 2] = a/b - c/b*(d-a*f/b)/(e-c*f/b);
-            right_hand_side[(j*size_x + i)*4 + 3] = (d-a*f/b)/(e-c*f/b);
-        }
+    int last = history->get_frame_count() - 1;
+    if (last >= 0) {
+        this->restore_state(last);
     }
 }
 
+HistoryHeader PendulumSystem::get_history_header(double time_step, double integration_step)
+{
+    HistoryHeader header;
+    header.size_x = size_x;
+    header.size_y = size_y;
+    header.bounds = bounds;
+    header.mass_1 = mass_1;
+    header.mass_2 = mass_2;
+    header.length_1 = length_1;
+    header.length_2 = length_2;
+    header.time_step = time_step;
+    header.integration_step = integration_step;
+    header.values_per_frame = degrees_of_freedom;
+    // The states of the float precision fit into floats.
+    header.value_size = precision == Precision::Float ? sizeof(float) : sizeof(double);
+    return header;
+}
+
+void PendulumSystem::get_right_hand_side(const double time, const std::vector<double>& state, std::vector<double>& right_hand_side)
+{
+    rhs_kernel(parameters, state.data(), right_hand_side.data(), pendulum_count, pendulum_count);
+}
+
+void PendulumSystem::get_right_hand_side(const double time, const double* state, double* right_hand_side, int stride, int count)
+{
+    rhs_kernel(parameters, state, right_hand_side, stride, count);
+}
+
 void PendulumSystem::set_initial_conditions(const double time)
 {
-    for(int i = 0; i < this->size_x; i++){
-        for(int j = 0; j < this->size_y; j++){
+    for(int j = 0; j < this->size_y; j++){
+        for(int i = 0; i < this->size_x; i++){
             set_der_phi_1(i, j, 0);
             set_der_phi_2(i, j, 0);
-            set_phi_1(i, j, bounds[0] + (i + 1)*(bounds[1] - bounds[0])/(size_x + 1));
-            set_phi_2(i, j, bounds[2] + (j + 1)*(bounds[3] - bounds[2])/(size_y + 1));
+            // Weighted so that bounds symmetric about the origin give exactly opposite points.
+            set_phi_1(i, j, ((size_x - i)*bounds[0] + (i + 1)*bounds[1])/(size_x + 1));
+            set_phi_2(i, j, ((size_y - j)*bounds[2] + (j + 1)*bounds[3])/(size_y + 1));
+        }
+    }
+
+    // The pendulums start at rest, so their energy is the potential energy of the initial angles
+    // and bounds the potential energy for all times. Lifting the first arm over the top needs at
+    // least (m1 + m2) g l1 - m2 g l2 (the second arm hanging down), lifting the second one at
+    // least m2 g l2 - (m1 + m2) g l1; a pendulum below both can never flip.
+    double g = parameters.g;
+    double flip_energy = -std::abs((mass_1 + mass_2)*length_1 - mass_2*length_2)*g;
+    for (int n = 0; n < pendulum_count; n++) {
+        double energy = -(mass_1 + mass_2)*g*length_1*std::cos(state[n]) - mass_2*g*length_2*std::cos(state[pendulum_count + n]);
+        flip_times[n].store(energy < flip_energy ? flip_never : flip_not_yet, std::memory_order_relaxed);
+    }
+    flip_previous_state.clear();
+    flip_previous_number = -1;
+    update_active_components();
+}
+
+void PendulumSystem::reuse_trajectories(std::shared_ptr<FrameSink> frames, int pendulum_count,
+                                        std::vector<int> targets, std::vector<int> sources)
+{
+    if (targets.size() != sources.size())
+        throw std::invalid_argument("Every reused pendulum needs a source pendulum.");
+    if (targets.empty())
+        return;
+
+    reused_trajectories.push_back({frames, pendulum_count, std::move(targets), std::move(sources)});
+    update_active_components();
+}
+
+int PendulumSystem::get_reused_count()
+{
+    int count = 0;
+    for (const ReusedTrajectories& trajectories : reused_trajectories) {
+        count += trajectories.targets.size();
+    }
+    return count;
+}
+
+void PendulumSystem::update_active_components()
+{
+    // Reused pendulums are copied, mirrored ones negated and flipped ones retired; the solver
+    // skips all of them.
+    std::vector<bool> inactive(pendulum_count, false);
+    bool any_inactive = false;
+    for (const ReusedTrajectories& trajectories : reused_trajectories) {
+        for (int target : trajectories.targets) {
+            inactive[target] = true;
+            any_inactive = true;
+        }
+    }
+    for (int target : mirror_targets) {
+        inactive[target] = true;
+        any_inactive = true;
+    }
+    if (!selected.empty()) {
+        for (int n = 0; n < pendulum_count; n++) {
+            if (!selected[n]) {
+                inactive[n] = true;
+                any_inactive = true;
+            }
+        }
+    }
+    if (flip_time_mode) {
+        for (int n = 0; n < pendulum_count; n++) {
+            if (flip_times[n].load(std::memory_order_relaxed) != flip_not_yet) {
+                inactive[n] = true;
+                any_inactive = true;
+            }
+        }
+    }
+
+    if (!any_inactive) {
+        activate_all_components();
+        return;
+    }
+    std::vector<int> active;
+    for (int n = 0; n < pendulum_count; n++) {
+        if (!inactive[n]) {
+            active.push_back(n);
+        }
+    }
+    set_active_components(std::move(active));
+}
+
+int PendulumSystem::set_point_symmetry(bool enabled)
+{
+    if (enabled && !selected.empty())
+        throw std::logic_error("Point symmetry cannot be combined with a selection of pendulums.");
+    mirror_targets.clear();
+    mirror_sources.clear();
+    if (enabled) {
+        // The mirror of pendulum (i, j) is (size_x - 1 - i, size_y - 1 - j); the pair counts
+        // only where the states are exactly opposite.
+        for (int j = 0; j < size_y; j++) {
+            for (int i = 0; i < size_x; i++) {
+                int n = get_index(i, j);
+                int m = get_index(size_x - 1 - i, size_y - 1 - j);
+                if (m <= n)
+                    continue;
+                bool opposite = true;
+                for (int v = 0; v < 4; v++) {
+                    opposite = opposite && state[v*pendulum_count + m] == -state[v*pendulum_count + n];
+                }
+                if (opposite) {
+                    mirror_targets.push_back(m);
+                    mirror_sources.push_back(n);
+                }
+            }
         }
     }
+    update_active_components();
+    return mirror_targets.size();
+}
+
+void PendulumSystem::set_integrated_pendulums(const std::vector<int>& pendulums)
+{
+    // A mirrored pendulum would copy a pendulum which is possibly not integrated.
+    if (!pendulums.empty() && !mirror_targets.empty())
+        throw std::logic_error("A selection of pendulums cannot be combined with point symmetry.");
+    selected.clear();
+    if (!pendulums.empty()) {
+        selected.assign(pendulum_count, false);
+        for (int n : pendulums) {
+            selected.at(n) = true;
+        }
+    }
+    update_active_components();
+}
+
+void PendulumSystem::set_flip_time_mode(bool flip_time_mode)
+{
+    this->flip_time_mode = flip_time_mode;
+    update_active_components();
+}
+
+double PendulumSystem::find_flip_time(int n)
+{
+    // The angles between the previous and the current frame follow cubic Hermite polynomials.
+    // They are sampled to catch an arm which goes over the top and back between the frames, the
+    // first crossing is then refined by bisection. Returns flip_not_yet without a crossing.
+    const double pi = 3.141592653589793;
+    const int samples = 16;
+    double h = time - flip_previous_time;
+    double flip_time = flip_not_yet;
+    for (int angle = 0; angle < 2; angle++) {
+        double p0 = flip_previous_state[angle*pendulum_count + n];
+        double p1 = state[angle*pendulum_count + n];
+        double v0 = h*flip_previous_state[(angle + 2)*pendulum_count + n];
+        double v1 = h*state[(angle + 2)*pendulum_count + n];
+        // The Hermite basis of the values is convex and the one of the rates stays below 4/27.
+        if (std::max(std::abs(p0), std::abs(p1)) + 4.0/27*(std::abs(v0) + std::abs(v1)) <= pi)
+            continue;
+        auto position = [&](double s) {
+            double s2 = s*s;
+            double s3 = s2*s;
+            return (2*s3 - 3*s2 + 1)*p0 + (s3 - 2*s2 + s)*v0 + (-2*s3 + 3*s2)*p1 + (s3 - s2)*v1;
+        };
+
+        int sample = 1;
+        while (sample <= samples && std::abs(position(static_cast<double>(sample) / samples)) <= pi) {
+            sample++;
+        }
+        if (sample > samples) {
+            // The interpolation may stay below pi although the frame is above.
+            if (std::abs(p1) <= pi)
+                continue;
+            sample = samples;
+        }
+
+        double low = static_cast<double>(sample - 1) / samples;
+        double high = static_cast<double>(sample) / samples;
+        for (int iteration = 0; iteration < 40; iteration++) {
+            double s = (low + high) / 2;
+            if (std::abs(position(s)) > pi)
+                high = s;
+            else
+                low = s;
+        }
+        double crossing = flip_previous_time + high*h;
+        if (flip_time == flip_not_yet || crossing < flip_time) {
+            flip_time = crossing;
+        }
+    }
+    return flip_time;
+}
+
+void PendulumSystem::detect_flips(int number)
+{
+    const double pi = 3.141592653589793;
+    // Without the previous frame (the first frame, or a jump in the frames) only the current
+    // state is checked and a flip is dated to the current frame.
+    bool interpolate = number == flip_previous_number + 1 && flip_previous_state.size() == state.size();
+    bool flipped = false;
+    for (int n = 0; n < pendulum_count; n++) {
+        if (flip_times[n].load(std::memory_order_relaxed) != flip_not_yet || (!selected.empty() && !selected[n]))
+            continue;
+        double flip_time = flip_not_yet;
+        if (interpolate) {
+            flip_time = find_flip_time(n);
+        }
+        else if (std::abs(state[n]) > pi || std::abs(state[pendulum_count + n]) > pi) {
+            flip_time = time;
+        }
+        if (flip_time != flip_not_yet) {
+            flip_times[n].store(flip_time, std::memory_order_relaxed);
+            flipped = true;
+        }
+    }
+
+    flip_previous_state = state;
+    flip_previous_time = time;
+    flip_previous_number = number;
+    if (flipped) {
+        update_active_components();
+    }
+}
+
+void PendulumSystem::complete_frame(int number)
+{
+    for (const ReusedTrajectories& trajectories : reused_trajectories) {
+        for (int v = 0; v < 4; v++) {
+            for (int n = 0; n < trajectories.targets.size(); n++) {
+                state[v*pendulum_count + trajectories.targets[n]] =
+                    trajectories.frames->get_value(number, v*trajectories.pendulum_count + trajectories.sources[n]);
+            }
+        }
+    }
+    // 0 - x instead of -x, an integrated pendulum keeps zeros positive and so does its mirror.
+    for (int v = 0; v < 4; v++) {
+        for (int n = 0; n < mirror_targets.size(); n++) {
+            state[v*pendulum_count + mirror_targets[n]] = 0.0 - state[v*pendulum_count + mirror_sources[n]];
+        }
+    }
+    if (flip_time_mode) {
+        detect_flips(number);
+    }
+}
+
+namespace
+{
+    // Index of the last frame recorded at or before the time, -1 before the first frame.
+    int find_frame_before(FrameSink& frame_sink, double time)
+    {
+        int low = 0;
+        int high = frame_sink.get_frame_count();
+        while (low < high) {
+            int middle = (low + high) / 2;
+            if (frame_sink.get_frame_time(middle) <= time)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        return low - 1;
+    }
+}
+
+bool PendulumSystem::can_interpolate(double time)
+{
+    int frame_count = frame_sink->get_frame_count();
+    if (!frame_sink->is_lossless() || frame_count == 0)
+        return false;
+    if (time < frame_sink->get_frame_time(0) || time > frame_sink->get_frame_time(frame_count - 1))
+        return false;
+    int number = std::min(find_frame_before(*frame_sink, time), frame_count - 2);
+    return frame_count == 1 ? frame_sink->has_frame(0) : frame_sink->has_frame(number) && frame_sink->has_frame(number + 1);
+}
+
+void PendulumSystem::interpolate_state(double time, std::vector<double>& state)
+{
+    if (!can_interpolate(time))
+        throw std::invalid_argument("The time " + std::to_string(time) + " cannot be interpolated from the recorded frames.");
+
+    state.resize(degrees_of_freedom);
+    int frame_count = frame_sink->get_frame_count();
+    if (frame_count == 1) {
+        for (int k = 0; k < degrees_of_freedom; k++) {
+            state[k] = frame_sink->get_value(0, k);
+        }
+        return;
+    }
+
+    int number = std::min(find_frame_before(*frame_sink, time), frame_count - 2);
+    if (number != interpolation_frame) {
+        for (int end = 0; end < 2; end++) {
+            interpolation_states[end].resize(degrees_of_freedom);
+            interpolation_rates[end].resize(degrees_of_freedom);
+            for (int k = 0; k < degrees_of_freedom; k++) {
+                interpolation_states[end][k] = frame_sink->get_value(number + end, k);
+            }
+            rhs_kernel(parameters, interpolation_states[end].data(), interpolation_rates[end].data(), pendulum_count, pendulum_count);
+        }
+        interpolation_frame = number;
+    }
+
+    double start_time = frame_sink->get_frame_time(number);
+    double h = frame_sink->get_frame_time(number + 1) - start_time;
+    double s = (time - start_time) / h;
+    double s2 = s*s;
+    double s3 = s2*s;
+    double s4 = s3*s;
+    double s5 = s4*s;
+
+    // Quintic Hermite basis on [0, 1] for the value, first and second derivative at both ends.
+    double value_0 = 1 - 10*s3 + 15*s4 - 6*s5;
+    double rate_0 = s - 6*s3 + 8*s4 - 3*s5;
+    double acceleration_0 = 0.5*s2 - 1.5*s3 + 1.5*s4 - 0.5*s5;
+    double acceleration_1 = 0.5*s3 - s4 + 0.5*s5;
+    double rate_1 = -4*s3 + 7*s4 - 3*s5;
+    double value_1 = 10*s3 - 15*s4 + 6*s5;
+
+    double d_value_0 = -30*s2 + 60*s3 - 30*s4;
+    double d_rate_0 = 1 - 18*s2 + 32*s3 - 15*s4;
+    double d_acceleration_0 = s - 4.5*s2 + 6*s3 - 2.5*s4;
+    double d_acceleration_1 = 1.5*s2 - 4*s3 + 2.5*s4;
+    double d_rate_1 = -12*s2 + 28*s3 - 15*s4;
+    double d_value_1 = -d_value_0;
+
+    const std::vector<double>& y0 = interpolation_states[0];
+    const std::vector<double>& y1 = interpolation_states[1];
+    const std::vector<double>& f0 = interpolation_rates[0];
+    const std::vector<double>& f1 = interpolation_rates[1];
+    int angles = 2*pendulum_count;
+    for (int k = 0; k < angles; k++) {
+        // The rate of an angle is its velocity, the rate of the velocity its acceleration.
+        double p0 = y0[k], p1 = y1[k];
+        double v0 = h*f0[k], v1 = h*f1[k];
+        double a0 = h*h*f0[angles + k], a1 = h*h*f1[angles + k];
+        state[k] = value_0*p0 + rate_0*v0 + acceleration_0*a0 + acceleration_1*a1 + rate_1*v1 + value_1*p1;
+        state[angles + k] = (d_value_0*p0 + d_rate_0*v0 + d_acceleration_0*a0 + d_acceleration_1*a1
+                             + d_rate_1*v1 + d_value_1*p1) / h;
+    }
 }
 
 void PendulumSystem::write_state_to_file(int number, std::string folder_name)
 {
-    if (number >= this->state_history.size())
-        throw std::invalid_argument("Argument number is larger than size of state_history vector.");
+    if (!frame_sink->has_frame(number))
+        throw std::invalid_argument("Frame " + std::to_string(number) + " is not stored in the frame sink.");
 
     std::stringstream file_path;
     file_path <<  "results\\" << folder_name << "\\State_" << std::setw( 5 ) << std::setfill( '0' ) << number << ".txt";
@@ -52,7 +409,7 @@ void PendulumSystem::write_state_to_file(int number, std::string folder_name)
 
     file << std::scientific << std::setprecision(3);
 
-    file << this->time << std::endl << std::endl;
+    file << frame_sink->get_frame_time(number) << "\n\n";
     for(int j = 0; j < size_y; j++)
     {
         for( int i = 0; i < size_x; i++ )
@@ -63,21 +420,17 @@ void PendulumSystem::write_state_to_file(int number, std::string folder_name)
                  << get_phi_2(i, j, number) << " "
                  << get_der_phi_1(i, j, number) << " "
                  << get_der_phi_2(i, j, number);
-            file << std::endl;
+            file << '\n';
         }
-        file << std::endl;
+        file << '\n';
     }
 }
 
-void PendulumSystem::record_state()
-{
-    this->state_history.push_back(state);
-}
-
 void PendulumSystem::save_history_to_folder(std::string folder_name)
 {
-    for (int i = 0; i < this->state_history.size(); i++)
+    for (int i = 0; i < frame_sink->get_frame_count(); i++)
     {
-        write_state_to_file(i, folder_name);
+        if (frame_sink->has_frame(i))
+            write_state_to_file(i, folder_name);
     }
 }
\ No newline at end of file
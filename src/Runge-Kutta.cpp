@@ -1,29 +1,122 @@
 #include "Runge-Kutta.hpp"
 
-void RungeKutta::set_up(System *system, double time_step, double integration_step)
+template <class SystemT>
+void RungeKutta<SystemT>::set_up(SystemT *system, double time_step, double integration_step)
 {
-    int dof = system->get_degrees_of_freedom();
-    k1.resize(dof, 0);
-    k2.resize(dof, 0);
-    k3.resize(dof, 0);
-    k4.resize(dof, 0);
-    aux.resize(dof, 0);
-
+    // The stages of the whole state are only allocated once a step needs them.
+    this->degrees_of_freedom = system->get_degrees_of_freedom();
     this->time_step = time_step;
     this->integration_step = integration_step;
     this->current_system = system;
 }
 
-void RungeKutta::solve(double time_max)
+template <class SystemT>
+void RungeKutta<SystemT>::set_thread_count(int thread_count)
 {
-    int steps_count = std::ceil((time_max - this->current_system->get_time())/time_step);
-    this->current_system->record_state();
+    if (thread_count < 1)
+        throw std::invalid_argument("Thread count has to be positive.");
+    this->thread_count = thread_count;
+}
+
+template <class SystemT>
+void RungeKutta<SystemT>::set_tile_size(int tile_size)
+{
+    if (tile_size < 1)
+        throw std::invalid_argument("Tile size has to be positive.");
+    this->tile_size = tile_size;
+}
+
+template <class SystemT>
+void RungeKutta<SystemT>::set_method(IntegrationMethod method)
+{
+    this->method = method;
+}
+
+template <class SystemT>
+void RungeKutta<SystemT>::set_fused_kernel(bool fused_kernel)
+{
+    this->fused_kernel = fused_kernel;
+}
+
+template <class SystemT>
+void RungeKutta<SystemT>::set_time_batching(bool time_batching)
+{
+    this->time_batching = time_batching;
+}
+
+template <class SystemT>
+void RungeKutta<SystemT>::set_tolerances(double absolute_tolerance, double relative_tolerance)
+{
+    if (absolute_tolerance < 0 || relative_tolerance < 0 || absolute_tolerance + relative_tolerance <= 0)
+        throw std::invalid_argument("Tolerances have to be non-negative and not both zero.");
+    this->absolute_tolerance = absolute_tolerance;
+    this->relative_tolerance = relative_tolerance;
+}
+
+template <class SystemT>
+void RungeKutta<SystemT>::set_progress_callback(std::function<void(double progress, double remaining_time)> callback)
+{
+    this->progress_callback = callback;
+}
+
+template <class SystemT>
+void RungeKutta<SystemT>::set_frame_callback(std::function<void(int number, double time, const std::vector<double>& state)> callback)
+{
+    this->frame_callback = callback;
+}
+
+template <class SystemT>
+void RungeKutta<SystemT>::set_cancellation_flag(const std::atomic<bool>* cancelled)
+{
+    this->cancelled = cancelled;
+}
+
+template <class SystemT>
+void RungeKutta<SystemT>::set_print_progress(bool print_progress)
+{
+    this->print_progress = print_progress;
+}
+
+template <class SystemT>
+std::vector<WorkerStatistics> RungeKutta<SystemT>::get_thread_statistics()
+{
+    if (!scheduler)
+        return {};
+    return scheduler->get_statistics();
+}
+
+template <class SystemT>
+int RungeKutta<SystemT>::get_steps_count(double time_max)
+{
+    return std::max(0.0, std::ceil((time_max - this->current_system->get_time())/time_step));
+}
+
+template <class SystemT>
+void RungeKutta<SystemT>::reserve_frames(double time_max)
+{
+    FrameSink& frame_sink = this->current_system->get_frame_sink();
+    frame_sink.reserve(frame_sink.get_frame_count() + get_steps_count(time_max) + 1);
+}
+
+template <class SystemT>
+void RungeKutta<SystemT>::solve(double time_max)
+{
+    int steps_count = get_steps_count(time_max);
+    FrameSink& frame_sink = this->current_system->get_frame_sink();
+    reserve_frames(time_max);
+    // A system continuing a previous run already has its current state as the last frame.
+    if (frame_sink.get_frame_count() == 0) {
+        record_frame(frame_sink);
+    }
     auto clock_computation_start = std::chrono::high_resolution_clock::now();
 
     for(int k = 1; k <= steps_count; k++){
         auto clock_step_start = std::chrono::high_resolution_clock::now();
         this->integrate_step(time_max);
-        this->current_system->record_state();
+        if (is_cancelled()) {
+            break;
+        }
+        record_frame(frame_sink);
         auto clock_step_end = std::chrono::high_resolution_clock::now();
 
         double time_per_step = (std::chrono::duration<double>(clock_step_end - clock_step_start).count());
@@ -37,53 +130,414 @@ void RungeKutta::solve(double time_max)
         int minutes_elapsed = (static_cast<int>(elapsed_time) % 3600) / 60;
         int seconds_elapsed = elapsed_time - (hours_elapsed * 3600 + minutes_elapsed * 60);
 
-        std::cout << "Steps completed: " << k << " / " << steps_count << " => " << std::fixed
-                  << std::setprecision(2) << (double) k / (double) steps_count * 100.0 << "% ";
-        std::cout << "     Time elapsed: " << hours_elapsed << "h " << minutes_elapsed << "m "
-                  << seconds_elapsed << "s";
-        std::cout << "     Time remaining: " << hours_remaining << "h " << minutes_remaining << "m "
-                  << seconds_remaining << "s" << std::endl;
+        if (print_progress) {
+            std::cout << "Steps completed: " << k << " / " << steps_count << " => " << std::fixed
+                      << std::setprecision(2) << (double) k / (double) steps_count * 100.0 << "% ";
+            std::cout << "     Time elapsed: " << hours_elapsed << "h " << minutes_elapsed << "m "
+                      << seconds_elapsed << "s";
+            std::cout << "     Time remaining: " << hours_remaining << "h " << minutes_remaining << "m "
+                      << seconds_remaining << "s" << std::endl;
+        }
+
+        if (progress_callback) {
+            progress_callback((double) k / (double) steps_count, remaining_time);
+        }
+    }
+
+    if (scheduler && print_progress) {
+        scheduler->print_statistics(std::cout);
+    }
+}
+
+template <class SystemT>
+std::vector<double> RungeKutta<SystemT>::get_frame_times(double time_max)
+{
+    // Replays the stepping of solve without integrating, the times come out bitwise equal.
+    std::vector<double> frame_times;
+    double time = current_system->get_time();
+    frame_times.push_back(time);
+    int steps_count = get_steps_count(time_max);
+    for (int k = 1; k <= steps_count; k++) {
+        double end_time = std::min(time_max, time + this->time_step);
+        while(time <= end_time){
+            time += integration_step;
+        }
+        frame_times.push_back(time);
+    }
+    return frame_times;
+}
+
+template <class SystemT>
+void RungeKutta<SystemT>::record_frame(FrameSink& frame_sink)
+{
+    int number = frame_sink.get_frame_count();
+    current_system->complete_frame(number);
+    frame_sink.record(number, current_system->get_time(), current_system->get_state());
+    if (frame_callback) {
+        frame_callback(number, current_system->get_time(), current_system->get_state());
     }
 }
 
-void RungeKutta::integrate_step(double time_max)
+template <class SystemT>
+void RungeKutta<SystemT>::integrate_step(double time_max)
 {
+    if (method == IntegrationMethod::DormandPrince) {
+        if (current_system->get_component_count() == 0 || !current_system->is_autonomous())
+            throw std::logic_error("The adaptive method needs an autonomous system of independent components.");
+        integrate_step_tiled(time_max);
+        return;
+    }
+    // With time batching every tile goes through all substeps of the time step while it is in
+    // the cache. Several threads and a subset of the components need tiles anyway.
+    bool tiled = time_batching || thread_count > 1 || current_system->has_inactive_components();
+    if (tiled && current_system->get_component_count() > 0) {
+        integrate_step_tiled(time_max);
+        return;
+    }
+
+    if (k1.size() != degrees_of_freedom) {
+        for (std::vector<double>* stage : {&k1, &k2, &k3, &k4, &aux}) {
+            stage->assign(degrees_of_freedom, 0);
+        }
+    }
+    std::vector<double>& state = current_system->get_state();
     double start_time = current_system->get_time();
-    while(current_system->get_time() <= std::min(time_max, start_time + this->time_step)){
+    double end_time = std::min(time_max, start_time + this->time_step);
+    while(current_system->get_time() <= end_time && !is_cancelled()){
 
         // Computing k1
         current_system->get_right_hand_side(current_system->get_time(),
-                                            current_system->get_state(),
+                                            state,
                                             k1);
         
         // Computing k2
-        for(int i = 0; i < current_system->get_degrees_of_freedom(); i++){
-            aux[i] = current_system->get_state()[i] + 1.0/2 * this->integration_step * k1[i];
+        for(int i = 0; i < degrees_of_freedom; i++){
+            aux[i] = state[i] + 1.0/2 * this->integration_step * k1[i];
         }
         current_system->get_right_hand_side(current_system->get_time() + 1.0/2*integration_step,
                                             aux,
                                             k2);
         
         // Computing k3
-        for(int i = 0; i < current_system->get_degrees_of_freedom(); i++){
-            aux[i] = current_system->get_state()[i] + 1.0/2 * this->integration_step * k2[i];
+        for(int i = 0; i < degrees_of_freedom; i++){
+            aux[i] = state[i] + 1.0/2 * this->integration_step * k2[i];
         }
         current_system->get_right_hand_side(current_system->get_time() + 1.0/2*integration_step,
                                             aux,
                                             k3);
 
         // Computing k4
-        for(int i = 0; i < current_system->get_degrees_of_freedom(); i++){
-            aux[i] = current_system->get_state()[i] + this->integration_step * k3[i];
+        for(int i = 0; i < degrees_of_freedom; i++){
+            aux[i] = state[i] + this->integration_step * k3[i];
         }
         current_system->get_right_hand_side(current_system->get_time() + integration_step,
                                             aux,
                                             k4);
 
-        for(int i = 0; i < current_system->get_degrees_of_freedom(); i++){
-            current_system->get_state()[i] += 1.0/6 * integration_step * (k1[i] + 2*k2[i] + 2*k3[i] + k4[i]);
+        for(int i = 0; i < degrees_of_freedom; i++){
+            state[i] += 1.0/6 * integration_step * (k1[i] + 2*k2[i] + 2*k3[i] + k4[i]);
         }
         current_system->increase_time(integration_step);
+        rhs_evaluations += 4 * std::max(1, current_system->get_component_count());
 
     }
 }
+
+template <class SystemT>
+std::vector<double> RungeKutta<SystemT>::get_substep_times(double time_max)
+{
+    // Same stepping condition as the loop in integrate_step, so that both paths make the same
+    // number of substeps and end at the same time.
+    std::vector<double> substep_times;
+    double time = current_system->get_time();
+    double end_time = std::min(time_max, time + this->time_step);
+    while(time <= end_time){
+        substep_times.push_back(time);
+        time += integration_step;
+    }
+    return substep_times;
+}
+
+template <class SystemT>
+void RungeKutta<SystemT>::integrate_step_tiled(double time_max)
+{
+    std::vector<double> substep_times = get_substep_times(time_max);
+
+    int component_count = current_system->get_component_count();
+    const int* components = nullptr;
+    int active_count = component_count;
+    if (current_system->has_inactive_components()) {
+        components = current_system->get_active_components().data();
+        active_count = current_system->get_active_components().size();
+    }
+    int tile_count = (active_count + tile_size - 1) / tile_size;
+    int workers = std::max(1, std::min(thread_count, tile_count));
+
+    if (!scheduler || scheduler->get_thread_count() != workers) {
+        scheduler = std::make_unique<TaskScheduler>(workers);
+    }
+
+    bool adaptive = method == IntegrationMethod::DormandPrince;
+    tile_buffers.resize(workers);
+    for (TileBuffers& buffers : tile_buffers) {
+        int size = degrees_of_freedom / component_count * tile_size;
+        for (std::vector<double>* buffer : {&buffers.state, &buffers.k1, &buffers.k2, &buffers.k3, &buffers.k4, &buffers.aux}) {
+            buffer->resize(size);
+        }
+        if (adaptive) {
+            for (std::vector<double>* buffer : {&buffers.k5, &buffers.k6, &buffers.k7}) {
+                buffer->resize(size);
+            }
+            for (std::vector<double>* buffer : {&buffers.step, &buffers.current_step, &buffers.elapsed}) {
+                buffer->resize(tile_size);
+            }
+            buffers.index.resize(tile_size);
+        }
+    }
+    if (adaptive && step_sizes.size() != component_count) {
+        step_sizes.assign(component_count, integration_step);
+    }
+
+    // The adaptive method ends the time step at the same time as the fixed substeps.
+    double start_time = current_system->get_time();
+    double end_time = start_time;
+    for (int i = 0; i < substep_times.size(); i++) {
+        end_time += integration_step;
+    }
+
+    // Every task runs all substeps of the time step on one tile, so the stages never leave the
+    // cache and no synchronisation between the stages is needed. Tiles differ in cost once
+    // pendulums stop early or take adaptive steps; the scheduler lets idle threads steal them.
+    scheduler->run(tile_count, [&](int worker, int tile) {
+        if (is_cancelled()) {
+            return;
+        }
+        int first = tile * tile_size;
+        int count = std::min(tile_size, active_count - first);
+        if (adaptive) {
+            integrate_tile_adaptive(components, first, count, start_time, end_time - start_time, tile_buffers[worker]);
+        }
+        else {
+            integrate_tile(components, first, count, substep_times, tile_buffers[worker]);
+        }
+    });
+
+    for (int i = 0; i < substep_times.size(); i++) {
+        current_system->increase_time(integration_step);
+    }
+}
+
+template <class SystemT>
+void RungeKutta<SystemT>::integrate_tile(const int* components, int first, int count, const std::vector<double>& substep_times, TileBuffers& buffers)
+{
+    int component_count = current_system->get_component_count();
+    int values = degrees_of_freedom / component_count;
+    int size = values * tile_size;
+    std::vector<double>& state = current_system->get_state();
+
+    // The fused kernel works on the state in place when the tile is contiguous. The system is
+    // autonomous, the substeps only need their count.
+    bool fused = fused_kernel && current_system->has_rk4_kernel();
+    if (fused && !components) {
+        current_system->integrate_rk4(&state[first], component_count, count, integration_step, substep_times.size());
+        rhs_evaluations += 4LL * count * substep_times.size();
+        return;
+    }
+
+    double* y = buffers.state.data();
+    double* k1 = buffers.k1.data();
+    double* k2 = buffers.k2.data();
+    double* k3 = buffers.k3.data();
+    double* k4 = buffers.k4.data();
+    double* aux = buffers.aux.data();
+
+    for (int v = 0; v < values; v++) {
+        if (components) {
+            for (int n = 0; n < count; n++) {
+                y[v*tile_size + n] = state[v*component_count + components[first + n]];
+            }
+        } else {
+            std::copy_n(&state[v*component_count + first], count, &y[v*tile_size]);
+        }
+    }
+
+    if (fused) {
+        current_system->integrate_rk4(y, tile_size, count, integration_step, substep_times.size());
+    }
+    else {
+        for (double time : substep_times) {
+            current_system->get_right_hand_side(time, y, k1, tile_size, count);
+
+            for(int i = 0; i < size; i++){
+                aux[i] = y[i] + 1.0/2 * this->integration_step * k1[i];
+            }
+            current_system->get_right_hand_side(time + 1.0/2*integration_step, aux, k2, tile_size, count);
+
+            for(int i = 0; i < size; i++){
+                aux[i] = y[i] + 1.0/2 * this->integration_step * k2[i];
+            }
+            current_system->get_right_hand_side(time + 1.0/2*integration_step, aux, k3, tile_size, count);
+
+            for(int i = 0; i < size; i++){
+                aux[i] = y[i] + this->integration_step * k3[i];
+            }
+            current_system->get_right_hand_side(time + integration_step, aux, k4, tile_size, count);
+
+            for(int i = 0; i < size; i++){
+                y[i] += 1.0/6 * integration_step * (k1[i] + 2*k2[i] + 2*k3[i] + k4[i]);
+            }
+        }
+    }
+    rhs_evaluations += 4LL * count * substep_times.size();
+
+    for (int v = 0; v < values; v++) {
+        if (components) {
+            for (int n = 0; n < count; n++) {
+                state[v*component_count + components[first + n]] = y[v*tile_size + n];
+            }
+        } else {
+            std::copy_n(&y[v*tile_size], count, &state[v*component_count + first]);
+        }
+    }
+}
+
+namespace
+{
+    // Dormand-Prince 5(4) tableau; the weights of the fifth order solution are the last row of a
+    // and e holds the differences to the weights of the embedded fourth order solution.
+    const double dormand_prince_a[7][6] = {
+        {},
+        {1.0/5},
+        {3.0/40, 9.0/40},
+        {44.0/45, -56.0/15, 32.0/9},
+        {19372.0/6561, -25360.0/2187, 64448.0/6561, -212.0/729},
+        {9017.0/3168, -355.0/33, 46732.0/5247, 49.0/176, -5103.0/18656},
+        {35.0/384, 0, 500.0/1113, 125.0/192, -2187.0/6784, 11.0/84}
+    };
+    const double dormand_prince_e[7] = {
+        71.0/57600, 0, -71.0/16695, 71.0/1920, -17253.0/339200, 22.0/525, -1.0/40
+    };
+}
+
+template <class SystemT>
+void RungeKutta<SystemT>::integrate_tile_adaptive(const int* components, int first, int count, double start_time, double duration, TileBuffers& buffers)
+{
+    int component_count = current_system->get_component_count();
+    int values = degrees_of_freedom / component_count;
+    std::vector<double>& state = current_system->get_state();
+
+    double* y = buffers.state.data();
+    double* aux = buffers.aux.data();
+    double* k[7] = {buffers.k1.data(), buffers.k2.data(), buffers.k3.data(), buffers.k4.data(),
+                    buffers.k5.data(), buffers.k6.data(), buffers.k7.data()};
+    double* step = buffers.step.data();
+    double* h = buffers.current_step.data();
+    double* elapsed = buffers.elapsed.data();
+    int* index = buffers.index.data();
+
+    for (int n = 0; n < count; n++) {
+        index[n] = components ? components[first + n] : first + n;
+        step[n] = step_sizes[index[n]];
+        elapsed[n] = 0;
+    }
+    for (int v = 0; v < values; v++) {
+        for (int n = 0; n < count; n++) {
+            y[v*tile_size + n] = state[v*component_count + index[n]];
+        }
+    }
+
+    // The components of the tile advance with their own steps. The unfinished ones are kept at
+    // the front of the buffers, so the block right hand side always evaluates a dense range.
+    // The system is autonomous, so the time passed to it does not matter.
+    long long evaluations = count;
+    current_system->get_right_hand_side(start_time, y, k[0], tile_size, count);
+    int active = count;
+    while (active > 0) {
+        if (is_cancelled()) {
+            return;
+        }
+        for (int n = 0; n < active; n++) {
+            h[n] = std::min(step[n], duration - elapsed[n]);
+        }
+
+        // Stage 7 is evaluated at the fifth order solution, which stays in aux.
+        for (int stage = 1; stage < 7; stage++) {
+            const double* a = dormand_prince_a[stage];
+            for (int v = 0; v < values; v++) {
+                for (int n = 0; n < active; n++) {
+                    int i = v*tile_size + n;
+                    double sum = 0;
+                    for (int j = 0; j < stage; j++) {
+                        sum += a[j] * k[j][i];
+                    }
+                    aux[i] = y[i] + h[n] * sum;
+                }
+            }
+            current_system->get_right_hand_side(start_time, aux, k[stage], tile_size, active);
+        }
+        evaluations += 6LL * active;
+
+        int kept = 0;
+        for (int n = 0; n < active; n++) {
+            double error = 0;
+            for (int v = 0; v < values; v++) {
+                int i = v*tile_size + n;
+                double estimate = 0;
+                for (int j = 0; j < 7; j++) {
+                    estimate += dormand_prince_e[j] * k[j][i];
+                }
+                estimate *= h[n];
+                double scale = absolute_tolerance + relative_tolerance * std::max(std::abs(y[i]), std::abs(aux[i]));
+                error += (estimate / scale) * (estimate / scale);
+            }
+            error = std::sqrt(error / values);
+            // A NaN error would only shrink the step until it underflows.
+            if (!std::isfinite(error))
+                throw std::runtime_error("The adaptive method reached a non-finite state.");
+            double factor = error == 0 ? 5.0 : std::min(5.0, std::max(0.2, 0.9 * std::pow(error, -0.2)));
+
+            if (error <= 1) {
+                bool last = step[n] >= duration - elapsed[n];
+                for (int v = 0; v < values; v++) {
+                    int i = v*tile_size + n;
+                    y[i] = aux[i];
+                    // First same as last: the last stage is the first one of the next step.
+                    k[0][i] = k[6][i];
+                }
+                elapsed[n] = last ? duration : elapsed[n] + h[n];
+                // A step shortened to end the time step does not limit the next one.
+                if (!last) {
+                    step[n] = h[n] * factor;
+                }
+            }
+            else {
+                step[n] = h[n] * factor;
+                if (step[n] <= duration * 1e-12)
+                    throw std::runtime_error("The step size of the adaptive method underflowed.");
+            }
+
+            if (elapsed[n] == duration) {
+                for (int v = 0; v < values; v++) {
+                    state[v*component_count + index[n]] = y[v*tile_size + n];
+                }
+                step_sizes[index[n]] = step[n];
+                continue;
+            }
+            if (kept != n) {
+                for (int v = 0; v < values; v++) {
+                    y[v*tile_size + kept] = y[v*tile_size + n];
+                    k[0][v*tile_size + kept] = k[0][v*tile_size + n];
+                }
+                index[kept] = index[n];
+                step[kept] = step[n];
+                elapsed[kept] = elapsed[n];
+            }
+            kept++;
+        }
+        active = kept;
+    }
+    rhs_evaluations += evaluations;
+}
+
+template class RungeKutta<System>;
+template class RungeKutta<PendulumSystem>;
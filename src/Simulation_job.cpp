@@ -0,0 +1,66 @@
+#include "Simulation_job.hpp"
+
+SimulationJob::SimulationJob(std::shared_ptr<PendulumSystem> system, double time_max, double integration_step, double time_step,
+                             TrajectoryCache* trajectory_cache, IntegrationMethod method,
+                             double absolute_tolerance, double relative_tolerance)
+: system(system),
+integration_step(integration_step),
+time_step(time_step),
+method(method)
+{
+    solver.set_up(system.get(), time_step, integration_step);
+    solver.set_method(method);
+    solver.set_tolerances(absolute_tolerance, relative_tolerance);
+    if (system->get_frame_sink().get_frame_count() > 0) {
+        // The reused frames end where the continued run ended.
+        system->stop_reusing_trajectories();
+    }
+    else if (trajectory_cache && method == IntegrationMethod::RK4) {
+        reused_count = trajectory_cache->reuse(*system, integration_step, time_step, solver.get_frame_times(time_max));
+    }
+    solver.set_cancellation_flag(&cancelled);
+    solver.set_progress_callback([this](double progress, double remaining_time) {
+        this->progress = progress;
+        this->remaining_time = remaining_time;
+    });
+    solver.set_frame_callback([this](int number, double time, const std::vector<double>& state) {
+        DisplayFrame frame;
+        frame.number = number;
+        frame.time = time;
+        if (this->system->is_flip_time_mode()) {
+            render_flip_time_image(*this->system, time, frame.pixels);
+        }
+        else {
+            render_quadrant_image(*this->system, state, frame.pixels);
+        }
+        display_frames.try_push(std::move(frame));
+    });
+    // The GUI may be reading frames of a continued system, so the frame sink must not grow its
+    // storage once the solver thread runs.
+    solver.reserve_frames(time_max);
+    thread = std::thread(&SimulationJob::run, this, time_max);
+}
+
+SimulationJob::~SimulationJob()
+{
+    cancel();
+    thread.join();
+}
+
+void SimulationJob::run(double time_max)
+{
+    try {
+        solver.solve(time_max);
+    }
+    catch (const std::exception& exception) {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        error_message = exception.what();
+    }
+    finished = true;
+}
+
+std::string SimulationJob::get_error_message()
+{
+    std::lock_guard<std::mutex> lock(error_mutex);
+    return error_message;
+}
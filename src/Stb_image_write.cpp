@@ -0,0 +1,4 @@
+// The implementation of stb_image_write is compiled once here, so that both executables can
+// write images.
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
@@ -0,0 +1,180 @@
+#include "Task_scheduler.hpp"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+TaskScheduler::TaskScheduler(int thread_count)
+: thread_count(thread_count)
+{
+    if (thread_count < 1)
+        throw std::invalid_argument("Thread count has to be positive.");
+
+    statistics.resize(thread_count);
+    for (int worker = 0; worker < thread_count; worker++) {
+        queues.push_back(std::make_unique<WorkerQueue>());
+    }
+    for (int worker = 1; worker < thread_count; worker++) {
+        threads.emplace_back(&TaskScheduler::worker_loop, this, worker);
+    }
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    start_condition.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+void TaskScheduler::run(int task_count, const std::function<void(int worker, int task)>& task)
+{
+    auto clock_start = std::chrono::steady_clock::now();
+    std::vector<double> busy_before(thread_count);
+    for (int worker = 0; worker < thread_count; worker++) {
+        busy_before[worker] = statistics[worker].busy_time;
+
+        std::lock_guard<std::mutex> lock(queues[worker]->mutex);
+        int first = static_cast<long long>(task_count) * worker / thread_count;
+        int last = static_cast<long long>(task_count) * (worker + 1) / thread_count;
+        for (int i = first; i < last; i++) {
+            queues[worker]->tasks.push_back(i);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        current_task = &task;
+        running_workers = thread_count - 1;
+        generation++;
+    }
+    start_condition.notify_all();
+
+    process_tasks(0);
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        finish_condition.wait(lock, [this]() { return running_workers == 0; });
+        current_task = nullptr;
+    }
+
+    // Whatever part of the batch a worker did not spend on tasks, it spent waiting or stealing.
+    double duration = std::chrono::duration<double>(std::chrono::steady_clock::now() - clock_start).count();
+    for (int worker = 0; worker < thread_count; worker++) {
+        statistics[worker].idle_time += std::max(0.0, duration - (statistics[worker].busy_time - busy_before[worker]));
+    }
+
+    if (error) {
+        std::exception_ptr thrown = error;
+        error = nullptr;
+        std::rethrow_exception(thrown);
+    }
+}
+
+void TaskScheduler::worker_loop(int worker)
+{
+    long long seen_generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start_condition.wait(lock, [&]() { return stopping || generation != seen_generation; });
+            if (stopping) {
+                return;
+            }
+            seen_generation = generation;
+        }
+
+        process_tasks(worker);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running_workers--;
+        }
+        finish_condition.notify_one();
+    }
+}
+
+void TaskScheduler::process_tasks(int worker)
+{
+    int task;
+    bool stolen;
+    while (take_task(worker, task, stolen)) {
+        auto clock_task_start = std::chrono::steady_clock::now();
+        try {
+            (*current_task)(worker, task);
+        }
+        catch (...) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+            drop_tasks();
+        }
+        auto clock_task_end = std::chrono::steady_clock::now();
+
+        statistics[worker].busy_time += std::chrono::duration<double>(clock_task_end - clock_task_start).count();
+        statistics[worker].tasks_executed++;
+        if (stolen) {
+            statistics[worker].tasks_stolen++;
+        }
+    }
+}
+
+bool TaskScheduler::take_task(int worker, int& task, bool& stolen)
+{
+    {
+        WorkerQueue& own = *queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.front();
+            own.tasks.pop_front();
+            stolen = false;
+            return true;
+        }
+    }
+
+    // No tasks are added during a batch, so once every queue is empty the worker is done.
+    for (int offset = 1; offset < thread_count; offset++) {
+        WorkerQueue& victim = *queues[(worker + offset) % thread_count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            stolen = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskScheduler::drop_tasks()
+{
+    for (const std::unique_ptr<WorkerQueue>& queue : queues) {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        queue->tasks.clear();
+    }
+}
+
+void TaskScheduler::reset_statistics()
+{
+    statistics.assign(thread_count, WorkerStatistics());
+}
+
+void TaskScheduler::print_statistics(std::ostream& stream)
+{
+    for (int worker = 0; worker < thread_count; worker++) {
+        const WorkerStatistics& worker_statistics = statistics[worker];
+        double total = worker_statistics.busy_time + worker_statistics.idle_time;
+        stream << "Thread " << worker << ": busy " << std::fixed << std::setprecision(2)
+               << worker_statistics.busy_time << "s, idle " << worker_statistics.idle_time << "s ("
+               << (total > 0 ? worker_statistics.busy_time / total * 100.0 : 0.0) << "% busy), tasks "
+               << worker_statistics.tasks_executed << ", stolen " << worker_statistics.tasks_stolen << std::endl;
+    }
+}
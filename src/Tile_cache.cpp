@@ -0,0 +1,243 @@
+#include "Tile_cache.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+    TileHeader make_header(const TileSettings& settings, const TileKey& key, int tile_size)
+    {
+        TileHeader header;
+        header.size_x = settings.size_x;
+        header.size_y = settings.size_y;
+        header.bounds = settings.bounds;
+        header.mass_1 = settings.mass_1;
+        header.mass_2 = settings.mass_2;
+        header.length_1 = settings.length_1;
+        header.length_2 = settings.length_2;
+        header.integration_step = settings.integration_step;
+        header.time_step = settings.time_step;
+        header.time_max = settings.time_max;
+        // The tolerances do not matter for a fixed step.
+        bool adaptive = settings.method == IntegrationMethod::DormandPrince;
+        header.absolute_tolerance = adaptive ? settings.absolute_tolerance : 0;
+        header.relative_tolerance = adaptive ? settings.relative_tolerance : 0;
+        header.method = static_cast<std::int32_t>(settings.method);
+        header.instruction_set = static_cast<std::int32_t>(settings.instruction_set);
+        header.flip_time_mode = settings.flip_time_mode;
+        header.tile_size = tile_size;
+        header.level = key.level;
+        header.x = key.x;
+        header.y = key.y;
+        return header;
+    }
+
+    // Everything in front of the run count identifies the tile.
+    constexpr std::size_t key_size = offsetof(TileHeader, run_count);
+
+    void encode_runs(const std::vector<unsigned char>& pixels, std::vector<unsigned char>& runs)
+    {
+        runs.clear();
+        for (std::size_t k = 0; k < pixels.size(); ) {
+            std::size_t length = 1;
+            while (length < 65535 && k + 3*length < pixels.size()
+                   && std::equal(&pixels[k], &pixels[k] + 3, &pixels[k + 3*length])) {
+                length++;
+            }
+            runs.push_back(length & 0xff);
+            runs.push_back(length >> 8);
+            runs.insert(runs.end(), &pixels[k], &pixels[k] + 3);
+            k += 3*length;
+        }
+    }
+}
+
+TileCache::TileCache(std::string directory, std::uintmax_t disk_capacity, int memory_capacity)
+: directory(directory),
+disk_capacity(disk_capacity),
+memory_capacity(memory_capacity)
+{
+    std::filesystem::create_directories(directory);
+
+    // Files of earlier sessions are ordered by their last use, which is the modification time.
+    std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::directory_entry>> files;
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".tile") {
+            files.emplace_back(entry.last_write_time(), entry);
+        }
+    }
+    std::sort(files.begin(), files.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& file : files) {
+        touch_disk_file(file.second.path().filename().string(), file.second.file_size());
+    }
+}
+
+std::string TileCache::get_file_name(const TileHeader& header)
+{
+    // FNV-1a of the identifying bytes; the header in the file is compared in full on reading.
+    std::uint64_t hash = 14695981039346656037ull;
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&header);
+    for (std::size_t k = 0; k < key_size; k++) {
+        hash = (hash ^ bytes[k]) * 1099511628211ull;
+    }
+    std::stringstream file_name;
+    file_name << std::hex << std::setw(16) << std::setfill('0') << hash << ".tile";
+    return file_name.str();
+}
+
+void TileCache::touch_disk_file(const std::string& file_name, std::uintmax_t size)
+{
+    auto file = disk_files.find(file_name);
+    if (file != disk_files.end()) {
+        disk_usage -= file->second.size;
+        disk_order.erase(file->second.position);
+        disk_files.erase(file);
+    }
+    disk_order.push_front(file_name);
+    disk_files[file_name] = {disk_order.begin(), size};
+    disk_usage += size;
+
+    while (disk_usage > disk_capacity && !disk_order.empty()) {
+        std::string oldest = disk_order.back();
+        std::error_code error;
+        std::filesystem::remove(std::filesystem::path(directory) / oldest, error);
+        forget_disk_file(oldest);
+    }
+}
+
+void TileCache::forget_disk_file(const std::string& file_name)
+{
+    auto file = disk_files.find(file_name);
+    if (file == disk_files.end())
+        return;
+    disk_usage -= file->second.size;
+    disk_order.erase(file->second.position);
+    disk_files.erase(file);
+}
+
+void TileCache::keep_in_memory(const std::string& file_name, const std::vector<unsigned char>& pixels)
+{
+    auto tile = memory_tiles.find(file_name);
+    if (tile != memory_tiles.end()) {
+        memory_order.erase(tile->second.position);
+        memory_tiles.erase(tile);
+    }
+    if (memory_capacity <= 0)
+        return;
+    memory_order.push_front(file_name);
+    memory_tiles[file_name] = {memory_order.begin(), pixels};
+    while (memory_tiles.size() > memory_capacity) {
+        memory_tiles.erase(memory_order.back());
+        memory_order.pop_back();
+    }
+}
+
+bool TileCache::read_tile_file(const std::string& file_name, const TileHeader& header, std::vector<unsigned char>& pixels)
+{
+    std::ifstream file(std::filesystem::path(directory) / file_name, std::ifstream::binary);
+    if (!file)
+        return false;
+    TileHeader stored;
+    file.read(reinterpret_cast<char*>(&stored), sizeof(TileHeader));
+    std::size_t pixel_count = static_cast<std::size_t>(header.tile_size) * header.tile_size;
+    if (!file || std::memcmp(&stored, &header, key_size) != 0 || stored.run_count > pixel_count)
+        return false;
+
+    std::vector<unsigned char> runs(5 * static_cast<std::size_t>(stored.run_count));
+    file.read(reinterpret_cast<char*>(runs.data()), runs.size());
+    if (!file)
+        return false;
+    pixels.clear();
+    pixels.reserve(3 * pixel_count);
+    for (std::size_t k = 0; k < runs.size(); k += 5) {
+        std::size_t length = runs[k] | (runs[k + 1] << 8);
+        if (pixels.size() + 3*length > 3 * pixel_count)
+            return false;
+        for (std::size_t n = 0; n < length; n++) {
+            pixels.insert(pixels.end(), &runs[k + 2], &runs[k + 2] + 3);
+        }
+    }
+    return pixels.size() == 3 * pixel_count;
+}
+
+bool TileCache::load(const TileSettings& settings, const TileKey& key, int tile_size, std::vector<unsigned char>& pixels)
+{
+    TileHeader header = make_header(settings, key, tile_size);
+    std::string file_name = get_file_name(header);
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto tile = memory_tiles.find(file_name);
+    if (tile != memory_tiles.end()) {
+        memory_order.splice(memory_order.begin(), memory_order, tile->second.position);
+        pixels = tile->second.pixels;
+        hit_count++;
+        return true;
+    }
+
+    // Another process sharing the directory may have written or deleted the file meanwhile.
+    std::filesystem::path path = std::filesystem::path(directory) / file_name;
+    if (!read_tile_file(file_name, header, pixels)) {
+        forget_disk_file(file_name);
+        miss_count++;
+        return false;
+    }
+    std::error_code error;
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+    std::uintmax_t size = std::filesystem::file_size(path, error);
+    touch_disk_file(file_name, error ? 0 : size);
+    keep_in_memory(file_name, pixels);
+    hit_count++;
+    return true;
+}
+
+void TileCache::store(const TileSettings& settings, const TileKey& key, int tile_size, const std::vector<unsigned char>& pixels)
+{
+    TileHeader header = make_header(settings, key, tile_size);
+    std::string file_name = get_file_name(header);
+    std::vector<unsigned char> runs;
+    encode_runs(pixels, runs);
+    header.run_count = runs.size() / 5;
+
+    // Written under a temporary name first, so that no process reads a partial tile.
+    std::filesystem::path path = std::filesystem::path(directory) / file_name;
+    std::stringstream temporary_name;
+    temporary_name << file_name << "." << std::hex << std::hash<std::thread::id>()(std::this_thread::get_id()) << ".part";
+    std::filesystem::path temporary_path = std::filesystem::path(directory) / temporary_name.str();
+    {
+        std::ofstream file(temporary_path, std::ofstream::binary | std::ofstream::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(TileHeader));
+        file.write(reinterpret_cast<const char*>(runs.data()), runs.size());
+        if (!file)
+            throw std::ios_base::failure("Unable to write the tile: " + temporary_path.string());
+    }
+    std::filesystem::rename(temporary_path, path);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    touch_disk_file(file_name, sizeof(TileHeader) + runs.size());
+    keep_in_memory(file_name, pixels);
+}
+
+std::uintmax_t TileCache::get_disk_usage()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return disk_usage;
+}
+
+long long TileCache::get_hit_count()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return hit_count;
+}
+
+long long TileCache::get_miss_count()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return miss_count;
+}
@@ -0,0 +1,182 @@
+#include "Tile_pyramid.hpp"
+#include "Tile_cache.hpp"
+
+#include <cmath>
+#include <stdexcept>
+
+std::array<double, 4> get_tile_bounds(const TileSettings& settings, const TileKey& key, int tile_size)
+{
+    // Pixel widths of the level, the pendulums of level 0 are one grid spacing apart.
+    double scale = std::ldexp(1.0, -key.level);
+    double width = (settings.bounds[1] - settings.bounds[0]) / (settings.size_x + 1) * scale;
+    double height = (settings.bounds[3] - settings.bounds[2]) / (settings.size_y + 1) * scale;
+    double left = settings.bounds[0] + (settings.bounds[1] - settings.bounds[0]) / (settings.size_x + 1) / 2;
+    double top = settings.bounds[3] - (settings.bounds[3] - settings.bounds[2]) / (settings.size_y + 1) / 2;
+
+    // The system puts its pendulums 1, ..., tile_size spacings above its lower bounds.
+    double left_bound = left + (key.x * tile_size - 0.5) * width;
+    double lower_bound = top - ((key.y + 1) * tile_size + 0.5) * height;
+    return {left_bound, left_bound + (tile_size + 1) * width, lower_bound, lower_bound + (tile_size + 1) * height};
+}
+
+bool render_tile(const TileSettings& settings, const TileKey& key, int tile_size, std::vector<unsigned char>& pixels,
+                 int thread_count, const std::atomic<bool>* cancelled)
+{
+    PendulumSystem system(tile_size, tile_size, get_tile_bounds(settings, key, tile_size),
+                          settings.mass_1, settings.mass_2, settings.length_1, settings.length_2);
+    system.set_instruction_set(settings.instruction_set);
+    system.set_flip_time_mode(settings.flip_time_mode);
+    system.set_frame_sink(std::make_shared<DiscardFrameSink>(nullptr));
+
+    RungeKutta<PendulumSystem> solver;
+    solver.set_up(&system, settings.time_step, settings.integration_step);
+    solver.set_print_progress(false);
+    solver.set_method(settings.method);
+    solver.set_tolerances(settings.absolute_tolerance, settings.relative_tolerance);
+    if (thread_count > 0) {
+        solver.set_thread_count(thread_count);
+    }
+    solver.set_cancellation_flag(cancelled);
+    solver.solve(settings.time_max);
+    if (cancelled && *cancelled)
+        return false;
+
+    if (settings.flip_time_mode) {
+        render_flip_time_image(system, system.get_time(), pixels);
+    }
+    else {
+        render_quadrant_image(system, system.get_state(), pixels);
+    }
+    return true;
+}
+
+TilePyramid::TilePyramid(int tile_size, TileCache* tile_cache)
+: tile_size(tile_size),
+tile_cache(tile_cache)
+{
+    if (tile_size < 1)
+        throw std::invalid_argument("Tile size has to be positive.");
+    thread = std::thread(&TilePyramid::run, this);
+}
+
+TilePyramid::~TilePyramid()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        cancelled = true;
+    }
+    condition.notify_all();
+    thread.join();
+}
+
+void TilePyramid::set_settings(const TileSettings& settings)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (settings == this->settings)
+        return;
+    this->settings = settings;
+    generation++;
+    tiles.clear();
+    pending.clear();
+    finished.clear();
+    cancelled = true;
+}
+
+int TilePyramid::get_generation()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return generation;
+}
+
+void TilePyramid::request_tiles(const std::vector<TileKey>& keys)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.clear();
+        for (const TileKey& key : keys) {
+            if (tiles.count(key) == 0 && !(computing && key == computed_key)) {
+                pending.push_back(key);
+            }
+        }
+    }
+    condition.notify_all();
+}
+
+bool TilePyramid::is_busy()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return computing || !pending.empty();
+}
+
+bool TilePyramid::pop_finished_tile(TileKey& key, std::vector<unsigned char>& pixels)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (finished.empty())
+        return false;
+    key = finished.front().first;
+    pixels = std::move(finished.front().second);
+    finished.pop_front();
+    return true;
+}
+
+void TilePyramid::release_tile(const TileKey& key)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    tiles.erase(key);
+}
+
+std::string TilePyramid::take_error_message()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string message;
+    std::swap(message, error_message);
+    return message;
+}
+
+void TilePyramid::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        condition.wait(lock, [this]() { return stopping || !pending.empty(); });
+        if (stopping)
+            return;
+        TileKey key = pending.front();
+        pending.pop_front();
+        TileSettings tile_settings = settings;
+        int tile_generation = generation;
+        computing = true;
+        computed_key = key;
+        cancelled = false;
+        lock.unlock();
+
+        std::vector<unsigned char> pixels;
+        std::string message;
+        bool complete = false;
+        try {
+            complete = tile_cache && tile_cache->load(tile_settings, key, tile_size, pixels);
+            if (!complete) {
+                complete = render_tile(tile_settings, key, tile_size, pixels, 0, &cancelled);
+                if (complete && tile_cache) {
+                    tile_cache->store(tile_settings, key, tile_size, pixels);
+                }
+            }
+        }
+        catch (const std::exception& exception) {
+            message = exception.what();
+        }
+
+        lock.lock();
+        computing = false;
+        if (tile_generation != generation || (!complete && message.empty()))
+            continue;
+        if (!message.empty()) {
+            // The other tiles would fail the same way.
+            error_message = message;
+            pending.clear();
+            continue;
+        }
+        tiles.insert(key);
+        finished.emplace_back(key, std::move(pixels));
+    }
+}
@@ -0,0 +1,128 @@
+#include "Trajectory_cache.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+std::size_t TrajectoryCache::InitialConditionHash::operator()(const InitialCondition& condition) const
+{
+    std::uint64_t hash = 14695981039346656037ull;
+    for (double value : condition) {
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        hash = (hash ^ bits) * 1099511628211ull;
+    }
+    return static_cast<std::size_t>(hash ^ (hash >> 32));
+}
+
+bool TrajectoryCache::InitialConditionEqual::operator()(const InitialCondition& a, const InitialCondition& b) const
+{
+    // Bitwise, so that the comparison agrees with the hash (0.0 and -0.0 differ).
+    return std::memcmp(a.data(), b.data(), sizeof(InitialCondition)) == 0;
+}
+
+TrajectoryCache::TrajectoryCache(int capacity)
+: capacity(capacity)
+{
+    if (capacity < 1)
+        throw std::invalid_argument("Trajectory cache capacity has to be positive.");
+}
+
+void TrajectoryCache::add(std::shared_ptr<PendulumSystem> system, double integration_step, double time_step)
+{
+    FrameSink& frames = system->get_frame_sink();
+    int frame_count = frames.get_frame_count();
+    // Flipped pendulums stop moving in the frames of the first flip time mode.
+    if (system->is_flip_time_mode() || !frames.is_lossless() || frame_count == 0)
+        return;
+    for (int number = 0; number < frame_count; number++) {
+        if (!frames.has_frame(number))
+            return;
+    }
+
+    for (auto run = runs.begin(); run != runs.end(); ++run) {
+        if (run->system == system) {
+            runs.erase(run);
+            break;
+        }
+    }
+
+    CachedRun run{system, integration_step, time_step, {}};
+    int pendulum_count = system->get_pendulum_count();
+    run.pendulums.reserve(pendulum_count);
+    for (int n = 0; n < pendulum_count; n++) {
+        InitialCondition condition;
+        for (int v = 0; v < 4; v++) {
+            condition[v] = frames.get_value(0, v*pendulum_count + n);
+        }
+        run.pendulums.emplace(condition, n);
+    }
+
+    runs.push_front(std::move(run));
+    while (runs.size() > capacity) {
+        runs.pop_back();
+    }
+}
+
+void TrajectoryCache::clear()
+{
+    runs.clear();
+}
+
+bool TrajectoryCache::is_compatible(CachedRun& run, PendulumSystem& system, double integration_step, double time_step,
+                                    const std::vector<double>& frame_times)
+{
+    if (run.system.get() == &system || run.integration_step != integration_step || run.time_step != time_step)
+        return false;
+
+    PendulumParameters a = run.system->get_parameters();
+    PendulumParameters b = system.get_parameters();
+    if (a.mass_1 != b.mass_1 || a.mass_2 != b.mass_2 || a.length_1 != b.length_1 ||
+        a.length_2 != b.length_2 || a.g != b.g)
+        return false;
+    // The scalar and the vector kernels round differently.
+    if (run.system->get_instruction_set() != system.get_instruction_set() || run.system->get_precision() != system.get_precision())
+        return false;
+
+    FrameSink& frames = run.system->get_frame_sink();
+    if (frames.get_frame_count() < frame_times.size())
+        return false;
+    for (int number = 0; number < frame_times.size(); number++) {
+        if (frames.get_frame_time(number) != frame_times[number])
+            return false;
+    }
+    return true;
+}
+
+int TrajectoryCache::reuse(PendulumSystem& system, double integration_step, double time_step, const std::vector<double>& frame_times)
+{
+    int pendulum_count = system.get_pendulum_count();
+    std::vector<bool> reused(pendulum_count, false);
+    int reused_count = 0;
+
+    for (CachedRun& run : runs) {
+        if (!is_compatible(run, system, integration_step, time_step, frame_times))
+            continue;
+
+        std::vector<int> targets;
+        std::vector<int> sources;
+        for (int n = 0; n < pendulum_count; n++) {
+            if (reused[n])
+                continue;
+            InitialCondition condition;
+            for (int v = 0; v < 4; v++) {
+                condition[v] = system.get_state()[v*pendulum_count + n];
+            }
+            auto found = run.pendulums.find(condition);
+            if (found != run.pendulums.end()) {
+                reused[n] = true;
+                targets.push_back(n);
+                sources.push_back(found->second);
+            }
+        }
+
+        reused_count += targets.size();
+        system.reuse_trajectories(run.system->get_frame_sink_pointer(), run.system->get_pendulum_count(),
+                                  std::move(targets), std::move(sources));
+    }
+    return reused_count;
+}
@@ -0,0 +1,315 @@
+// Runs pendulum systems without a window, e.g. on compute nodes:
+//
+//     Double-pendulums-headless [--verbose] [key=value ...] job_file ...
+//
+// Every job file is one run, the key=value arguments override the values of all job files. With
+// no job file a single run is made from the arguments alone.
+#include "stb_image_write.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Adaptive_sampler.hpp"
+#include "Job_description.hpp"
+#include "Pendulum_image.hpp"
+#include "Pendulum_system.hpp"
+#include "Runge-Kutta.hpp"
+#include "Tile_cache.hpp"
+
+namespace
+{
+    void write_png(const JobDescription& job, int number, const std::vector<unsigned char>& pixels)
+    {
+        std::stringstream file_path;
+        file_path << job.image_folder << "/" << job.name << "_" << std::setw(5) << std::setfill('0') << number << ".png";
+        if (!stbi_write_png(file_path.str().c_str(), job.size_x, job.size_y, 3, pixels.data(), job.size_x * 3))
+            throw std::ios_base::failure("Unable to write the image: " + file_path.str());
+    }
+
+    void write_image(const JobDescription& job, PendulumSystem& system, int number, double time, const std::vector<double>& state)
+    {
+        std::vector<unsigned char> pixels;
+        if (job.flip_time_mode) {
+            render_flip_time_image(system, time, pixels);
+        }
+        else {
+            render_quadrant_image(system, state, pixels);
+        }
+        write_png(job, number, pixels);
+    }
+
+    void write_flip_times(const JobDescription& job, PendulumSystem& system)
+    {
+        std::ofstream file(job.flip_time_file);
+        if (!file)
+            throw std::ios_base::failure("Unable to open the file: " + job.flip_time_file);
+        file << std::setprecision(17);
+        for (int j = 0; j < job.size_y; j++) {
+            for (int i = 0; i < job.size_x; i++) {
+                file << (i > 0 ? " " : "") << system.get_flip_time(i, j);
+            }
+            file << '\n';
+        }
+    }
+
+    void render_image(const JobDescription& job, PendulumSystem& system, std::vector<unsigned char>& pixels)
+    {
+        if (job.flip_time_mode) {
+            render_flip_time_image(system, job.max_time, pixels);
+        }
+        else {
+            render_quadrant_image(system, system.get_state(), pixels);
+        }
+    }
+
+    // Compares the last map of a job run in a lower precision with the same run in double
+    // precision: the share of pixels of another colour and the differences of the angles.
+    void print_accuracy_report(const JobDescription& job, PendulumSystem& system)
+    {
+        PendulumSystem reference(job.size_x, job.size_y, job.bounds, job.mass_1, job.mass_2, job.length_1, job.length_2);
+        reference.set_flip_time_mode(job.flip_time_mode);
+        reference.set_point_symmetry(job.point_symmetry.value_or(true));
+        reference.set_frame_sink(std::make_shared<DiscardFrameSink>(nullptr));
+        RungeKutta<PendulumSystem> solver;
+        solver.set_up(&reference, job.time_step, job.integration_step);
+        solver.set_print_progress(false);
+        solver.set_method(job.method);
+        solver.set_tolerances(job.absolute_tolerance, job.relative_tolerance);
+        if (job.threads > 0) {
+            solver.set_thread_count(job.threads);
+        }
+        solver.solve(job.max_time);
+
+        std::vector<unsigned char> pixels, reference_pixels;
+        render_image(job, system, pixels);
+        render_image(job, reference, reference_pixels);
+        int pendulum_count = system.get_pendulum_count();
+        int different_pixels = 0;
+        for (int n = 0; n < pendulum_count; n++) {
+            different_pixels += !std::equal(&pixels[3*n], &pixels[3*n] + 3, &reference_pixels[3*n]);
+        }
+
+        // Angles are compared on the circle, a full turn apart is no difference.
+        const std::vector<double>& state = system.get_state();
+        const std::vector<double>& reference_state = reference.get_state();
+        double max_difference = 0;
+        double square_sum = 0;
+        for (int k = 0; k < 2*pendulum_count; k++) {
+            double difference = std::abs(std::remainder(state[k] - reference_state[k], 2*PI));
+            max_difference = std::max(max_difference, difference);
+            square_sum += difference*difference;
+        }
+        std::cout << job.name << ": " << get_precision_name(job.precision) << " against double, "
+                  << std::fixed << std::setprecision(3) << 100.0 * different_pixels / pendulum_count
+                  << "% of the pixels differ, angles differ by " << std::scientific << std::setprecision(2)
+                  << std::sqrt(square_sum / (2*pendulum_count)) << " rad RMS and " << max_difference
+                  << " rad at most" << std::endl;
+    }
+
+    // Writes the map at the maximum time only, see AdaptiveSampler.
+    void run_adaptive_job(const JobDescription& job)
+    {
+        if (!job.history_file.empty())
+            throw std::invalid_argument("Adaptive sampling does not record a history.");
+        // The reference of the report is a full run, it would count the sampling error as well.
+        if (job.accuracy_report)
+            throw std::invalid_argument("Adaptive sampling has no accuracy report.");
+        // The sampler integrates subsets of the grid, which cannot have mirrored pendulums.
+        if (job.point_symmetry.value_or(false))
+            throw std::invalid_argument("Adaptive sampling does not mirror pendulums, set point_symmetry = false.");
+        auto clock_start = std::chrono::steady_clock::now();
+
+        auto system = std::make_shared<PendulumSystem>(job.size_x, job.size_y, job.bounds,
+                                                       job.mass_1, job.mass_2, job.length_1, job.length_2);
+        system->set_flip_time_mode(job.flip_time_mode);
+        system->set_precision(job.precision);
+        AdaptiveSampler sampler(system, job.integration_step, job.time_step);
+        sampler.set_coarse_cell_size(job.coarse_cell_size);
+        sampler.set_tolerance(job.refinement_tolerance);
+        sampler.set_thread_count(job.threads);
+        sampler.set_method(job.method, job.absolute_tolerance, job.relative_tolerance);
+        sampler.sample(job.max_time);
+
+        if (!job.image_folder.empty()) {
+            std::filesystem::create_directories(job.image_folder);
+            write_image(job, *system, std::max(0, (int) std::ceil(job.max_time / job.time_step)), job.max_time, system->get_state());
+        }
+        if (job.flip_time_mode && !job.flip_time_file.empty()) {
+            write_flip_times(job, *system);
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - clock_start).count();
+        std::cout << job.name << ": " << system->get_pendulum_count() << " pendulums, "
+                  << sampler.get_integrated_count() << " integrated, " << std::fixed
+                  << std::setprecision(3) << seconds << "s" << std::endl;
+    }
+
+    // One cache per directory, so that the jobs of a process share the tiles held in memory.
+    TileCache& get_tile_cache(const JobDescription& job)
+    {
+        static std::map<std::string, std::unique_ptr<TileCache>> tile_caches;
+        std::unique_ptr<TileCache>& tile_cache = tile_caches[job.tile_cache];
+        if (!tile_cache) {
+            tile_cache = std::make_unique<TileCache>(job.tile_cache, static_cast<std::uintmax_t>(job.tile_cache_size) << 20);
+        }
+        return *tile_cache;
+    }
+
+    // Puts the last image together from tiles of level 0, which are the pixels of the grid.
+    void run_tiled_job(const JobDescription& job)
+    {
+        if (!job.history_file.empty() || !job.flip_time_file.empty() || job.image_every > 0 || job.adaptive_sampling)
+            throw std::invalid_argument("A job with a tile cache can only write the last image.");
+        if (job.precision != Precision::Double || job.accuracy_report)
+            throw std::invalid_argument("Tiles are computed in double precision.");
+        auto clock_start = std::chrono::steady_clock::now();
+
+        TileCache& tile_cache = get_tile_cache(job);
+        TileSettings settings = {job.size_x, job.size_y, job.bounds, job.mass_1, job.mass_2, job.length_1, job.length_2,
+                                 job.integration_step, job.time_step, job.max_time, job.method, job.absolute_tolerance,
+                                 job.relative_tolerance, job.flip_time_mode, get_default_instruction_set()};
+        int tiles_x = (job.size_x + job.tile_size - 1) / job.tile_size;
+        int tiles_y = (job.size_y + job.tile_size - 1) / job.tile_size;
+        int cached_count = 0;
+        std::vector<unsigned char> image(3 * job.size_x * job.size_y);
+        std::vector<unsigned char> pixels;
+        for (int y = 0; y < tiles_y; y++) {
+            for (int x = 0; x < tiles_x; x++) {
+                TileKey key = {0, x, y};
+                if (tile_cache.load(settings, key, job.tile_size, pixels)) {
+                    cached_count++;
+                }
+                else {
+                    render_tile(settings, key, job.tile_size, pixels, job.threads);
+                    tile_cache.store(settings, key, job.tile_size, pixels);
+                }
+                int width = std::min(job.tile_size, job.size_x - x * job.tile_size);
+                int height = std::min(job.tile_size, job.size_y - y * job.tile_size);
+                for (int row = 0; row < height; row++) {
+                    std::copy_n(&pixels[3 * row * job.tile_size], 3 * width,
+                                &image[3 * ((y * job.tile_size + row) * job.size_x + x * job.tile_size)]);
+                }
+            }
+        }
+
+        if (!job.image_folder.empty()) {
+            std::filesystem::create_directories(job.image_folder);
+            write_png(job, std::max(0, (int) std::ceil(job.max_time / job.time_step)), image);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - clock_start).count();
+        std::cout << job.name << ": " << tiles_x * tiles_y << " tiles, " << cached_count << " from the cache, "
+                  << std::fixed << std::setprecision(3) << seconds << "s" << std::endl;
+    }
+
+    void run_job(const JobDescription& job, bool verbose)
+    {
+        if (!job.tile_cache.empty()) {
+            run_tiled_job(job);
+            return;
+        }
+        if (job.adaptive_sampling) {
+            run_adaptive_job(job);
+            return;
+        }
+        auto clock_start = std::chrono::steady_clock::now();
+
+        auto system = std::make_shared<PendulumSystem>(job.size_x, job.size_y, job.bounds,
+                                                       job.mass_1, job.mass_2, job.length_1, job.length_2);
+        RungeKutta<PendulumSystem> solver;
+        solver.set_up(system.get(), job.time_step, job.integration_step);
+        solver.set_print_progress(verbose);
+        solver.set_method(job.method);
+        solver.set_tolerances(job.absolute_tolerance, job.relative_tolerance);
+        solver.set_fused_kernel(job.fused_kernel);
+        solver.set_time_batching(job.time_batching);
+        system->set_flip_time_mode(job.flip_time_mode);
+        system->set_point_symmetry(job.point_symmetry.value_or(true));
+        system->set_precision(job.precision);
+        if (job.threads > 0) {
+            solver.set_thread_count(job.threads);
+        }
+
+        // Frames are only kept when a history file is written.
+        if (!job.history_file.empty()) {
+            system->set_frame_sink(std::make_shared<FileFrameSink>(
+                job.history_file, system->get_history_header(job.time_step, job.integration_step)));
+        }
+        else {
+            system->set_frame_sink(std::make_shared<DiscardFrameSink>(nullptr));
+        }
+
+        if (!job.image_folder.empty()) {
+            std::filesystem::create_directories(job.image_folder);
+            int last = solver.get_steps_count(job.max_time);
+            solver.set_frame_callback([&](int number, double time, const std::vector<double>& state) {
+                bool selected = job.image_every > 0 && number % job.image_every == 0;
+                if (selected || number == last) {
+                    write_image(job, *system, number, time, state);
+                }
+            });
+        }
+
+        solver.solve(job.max_time);
+        if (job.flip_time_mode && !job.flip_time_file.empty()) {
+            write_flip_times(job, *system);
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - clock_start).count();
+        std::cout << job.name << ": " << system->get_pendulum_count() << " pendulums, "
+                  << system->get_frame_sink().get_frame_count() << " frames, "
+                  << solver.get_rhs_evaluations() << " right hand side evaluations, " << std::fixed
+                  << std::setprecision(3) << seconds << "s" << std::endl;
+        if (job.accuracy_report) {
+            print_accuracy_report(job, *system);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool verbose = false;
+    std::vector<std::string> overrides;
+    std::vector<std::string> job_files;
+    for (int k = 1; k < argc; k++) {
+        std::string argument = argv[k];
+        if (argument == "--verbose")
+            verbose = true;
+        else if (argument.find('=') != std::string::npos)
+            overrides.push_back(argument);
+        else
+            job_files.push_back(argument);
+    }
+    if (job_files.empty() && overrides.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--verbose] [key=value ...] job_file ..." << std::endl;
+        return 2;
+    }
+
+    // A failed job does not stop the remaining ones.
+    int failed_count = 0;
+    int job_count = std::max<int>(1, job_files.size());
+    for (int k = 0; k < job_count; k++) {
+        try {
+            JobDescription job = job_files.empty() ? JobDescription() : read_job_file(job_files[k]);
+            for (const std::string& line : overrides) {
+                read_job_line(job, line);
+            }
+            validate_job(job);
+            run_job(job, verbose);
+        }
+        catch (const std::exception& exception) {
+            std::cerr << (job_files.empty() ? "job" : job_files[k]) << ": " << exception.what() << std::endl;
+            failed_count++;
+        }
+    }
+    return failed_count == 0 ? 0 : 1;
+}
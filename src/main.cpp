@@ -4,17 +4,22 @@
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
-#define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <string>
 
 #include "System.hpp"
+#include "Pendulum_image.hpp"
 #include "Pendulum_system.hpp"
 #include "Runge-Kutta.hpp"
-
-constexpr double PI = 3.141592653589793;
+#include "Simulation_job.hpp"
+#include "Tile_cache.hpp"
+#include "Tile_pyramid.hpp"
 
 GLuint create_texture(PendulumSystem* system) {
     GLuint tex;
@@ -37,46 +42,86 @@ GLuint create_texture(PendulumSystem* system) {
     return tex;
 }
 
-double normalize_angle(double angle)
-{
-    double normal_angle = angle - floor(angle/(2*PI))*2*PI;
-    return angle - floor(angle/(2*PI))*2*PI;
+GLuint create_tile_texture(int tile_size, const std::vector<unsigned char>& pixels) {
+    GLuint tex;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, tile_size, tile_size, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return tex;
 }
 
-void update_texture(GLuint texture, PendulumSystem* system, int number) {
-    glBindTexture(GL_TEXTURE_2D, texture);
+// A texture of a tile and the last frame it was drawn in.
+struct TileTexture
+{
+    GLuint texture;
+    long long last_drawn;
+};
 
-    int dof = system->get_degrees_of_freedom();
-    unsigned char* data = new unsigned char[dof * 3];
-    int index = 0;
-    for (int i = 0; i < system->get_size()[0]; i++) {
-        std::cout << "Here in 2 " << i << std::endl;
-        for (int j = 0; j < system->get_size()[1]; j++) {
-            index = 3*((system->get_size()[1] - 1 - j)*system->get_size()[0] + i);
-
-            data[index] = 0;        // R
-            data[index + 1] = 0;    // G
-            data[index + 2] = 0;    // B
-            std::cout << number << std::endl;
-            if (normalize_angle(system->get_phi_1(i, j, number)) <= PI &&
-                normalize_angle(system->get_phi_2(i, j, number)) <= PI) {
-                data[index] = 255;
-                data[index + 1] = 255;
-            }
-            else if (normalize_angle(system->get_phi_1(i, j, number)) <= PI &&
-                     normalize_angle(system->get_phi_2(i, j, number)) > PI) {
-                data[index] = 255;
-            }
-            else if (normalize_angle(system->get_phi_1(i, j, number)) > PI &&
-                     normalize_angle(system->get_phi_2(i, j, number)) <= PI){
-                data[index + 2] = 255;
-            }
-            else{
-                data[index + 1] = 255;
-            }
+void delete_tile_textures(std::map<TileKey, TileTexture>& tile_textures) {
+    for (auto& tile : tile_textures) {
+        glDeleteTextures(1, &tile.second.texture);
+    }
+    tile_textures.clear();
+}
+
+// Deletes the textures drawn longest ago until at most max_count are left, apart from those
+// drawn in the current frame. The pyramid hands a released tile out again when it is requested.
+void evict_tile_textures(std::map<TileKey, TileTexture>& tile_textures, TilePyramid& tile_pyramid,
+                         std::size_t max_count, long long frame) {
+    if (tile_textures.size() <= max_count)
+        return;
+    std::vector<std::pair<long long, TileKey>> by_age;
+    for (const auto& tile : tile_textures) {
+        if (tile.second.last_drawn != frame) {
+            by_age.emplace_back(tile.second.last_drawn, tile.first);
         }
     }
+    std::sort(by_age.begin(), by_age.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first;
+    });
+    std::size_t count = std::min(by_age.size(), tile_textures.size() - max_count);
+    for (std::size_t i = 0; i < count; i++) {
+        auto tile = tile_textures.find(by_age[i].second);
+        glDeleteTextures(1, &tile->second.texture);
+        tile_textures.erase(tile);
+        tile_pyramid.release_tile(by_age[i].second);
+    }
+}
+
+// Settings which determine the frames of a run, apart from its maximum time.
+struct RunSettings
+{
+    int size_x;
+    int size_y;
+    std::array<double, 4> bounds;
+    double integration_step;
+    double time_step;
+    std::string history_file;
+    bool quantize_history;
+    IntegrationMethod method;
+    double absolute_tolerance;
+    double relative_tolerance;
+    bool flip_time_mode;
+    bool point_symmetry;
+
+    bool operator==(const RunSettings& other) const {
+        return size_x == other.size_x && size_y == other.size_y && bounds == other.bounds
+               && integration_step == other.integration_step && time_step == other.time_step
+               && history_file == other.history_file && quantize_history == other.quantize_history
+               && method == other.method && absolute_tolerance == other.absolute_tolerance
+               && relative_tolerance == other.relative_tolerance && flip_time_mode == other.flip_time_mode
+               && point_symmetry == other.point_symmetry;
+    }
+};
 
+void upload_texture(GLuint texture, PendulumSystem* system, const std::vector<unsigned char>& pixels) {
+    glBindTexture(GL_TEXTURE_2D, texture);
     glTexSubImage2D(
         GL_TEXTURE_2D, 
         0,
@@ -85,20 +130,48 @@ void update_texture(GLuint texture, PendulumSystem* system, int number) {
         system->get_size()[1], 
         GL_RGB, 
         GL_UNSIGNED_BYTE, 
-        data
+        pixels.data()
     );
-
-    delete[] data;
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
-void calculate(PendulumSystem* system, double max_time, double integration_step, double time_step) {
-    RungeKutta solver;
-    solver.set_up(system, time_step, integration_step);
-    solver.solve(max_time);
-    //system->save_history_to_folder("vysledek");
+void update_texture(GLuint texture, PendulumSystem* system, int number) {
+    std::vector<unsigned char> pixels;
+    if (system->is_flip_time_mode()) {
+        render_flip_time_image(*system, system->get_frame_sink().get_frame_time(number), pixels);
+    }
+    else {
+        render_quadrant_image(*system, number, pixels);
+    }
+    upload_texture(texture, system, pixels);
 }
 
+// Shows the state at the given time, interpolated between the recorded frames when the frame sink
+// keeps them losslessly and the nearest stored frame otherwise. Returns the number of the shown
+// frame, -1 for an interpolated state.
+int update_texture_at_time(GLuint texture, PendulumSystem* system, double time, double time_step, int shown_frame) {
+    if (system->is_flip_time_mode()) {
+        std::vector<unsigned char> pixels;
+        render_flip_time_image(*system, time, pixels);
+        upload_texture(texture, system, pixels);
+        return -1;
+    }
+    if (system->can_interpolate(time)) {
+        std::vector<double> state;
+        std::vector<unsigned char> pixels;
+        system->interpolate_state(time, state);
+        render_quadrant_image(*system, state, pixels);
+        upload_texture(texture, system, pixels);
+        return -1;
+    }
+    FrameSink& frame_sink = system->get_frame_sink();
+    int number = std::min<int>(std::round(time/time_step), frame_sink.get_frame_count() - 1);
+    if (number >= 0 && frame_sink.has_frame(number)) {
+        update_texture(texture, system, number);
+        return number;
+    }
+    return shown_frame;
+}
 
 void save_image(GLuint texture, PendulumSystem* system, double show_time) {
     std::vector<unsigned char> pixels(system->get_size()[0] * system->get_size()[1] * 3);
@@ -155,6 +228,7 @@ int main() {
         return -1;
     }
     glfwMakeContextCurrent(window);
+    glfwSwapInterval(1);
     gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
 
     IMGUI_CHECKVERSION();
@@ -169,11 +243,46 @@ int main() {
     int size_y = 256;
     float show_time = 0;
     float max_time = 0.2;
+    // Maximum time of the shown run, the zoomed in tiles are computed up to it.
+    float run_max_time = max_time;
     double integration_step = 0.01;
     double time_step = 0.1;
-    PendulumSystem system(size_x, size_y, bounds, 1.0, 1.0, 1.0, 1.0);
-    GLuint texture = create_texture(&system);
+    auto system = std::make_shared<PendulumSystem>(size_x, size_y, bounds, 1.0, 1.0, 1.0, 1.0);
+    GLuint texture = create_texture(system.get());
     std::string output_file_name;
+    char history_file[256] = "";
+    bool quantize_history = false;
+    bool adaptive_step = false;
+    bool flip_time_mode = false;
+    bool point_symmetry = true;
+    bool animating = false;
+    float animation_speed = 1.0f;
+    double absolute_tolerance = 1e-8;
+    double relative_tolerance = 1e-8;
+
+    // The computation runs in the background so that the window keeps rendering. A cancelled job
+    // is kept until its thread stops, which lets a new job start right away.
+    std::unique_ptr<SimulationJob> job;
+    int shown_frame = -1;
+    RunSettings system_settings = {size_x, size_y, bounds, integration_step, time_step, "", false,
+                                   IntegrationMethod::RK4, absolute_tolerance, relative_tolerance, false, false};
+    std::vector<std::unique_ptr<SimulationJob>> cancelled_jobs;
+    // Finished runs, a new run copies the pendulums it shares with them.
+    TrajectoryCache trajectory_cache;
+
+    // Zoomed in, the visible part of the map at the end of the run is computed again at screen
+    // resolution in tiles, the image of the run is stretched until they are ready. The view is
+    // given by its centre in fractions of the image, from the top left corner, and its zoom.
+    float zoom = 1;
+    ImVec2 view_centre(0.5f, 0.5f);
+    // Tiles are kept on disk, so views of earlier sessions come back without integrating.
+    TileCache tile_cache("Tiles");
+    TilePyramid tile_pyramid(256, &tile_cache);
+    std::map<TileKey, TileTexture> tile_textures;
+    // About 200 MB of 256 x 256 tiles, enough for the view and its coarser levels on large screens.
+    const std::size_t max_tile_textures = 1024;
+    long long frame = 0;
+    int tile_generation = tile_pyramid.get_generation();
 
     while (!glfwWindowShouldClose(window)) {
         glfwPollEvents();
@@ -181,20 +290,157 @@ int main() {
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
 
+        // Frames of the running job are shown as soon as they are integrated, unless an animation
+        // plays the frames computed so far.
+        if (job && job->get_system() == system && !animating) {
+            DisplayFrame frame;
+            bool received = false;
+            while (job->pop_display_frame(frame)) {
+                received = true;
+            }
+            if (received) {
+                upload_texture(texture, system.get(), frame.pixels);
+                shown_frame = frame.number;
+                show_time = frame.time;
+            }
+        }
+        if (job && job->is_finished()) {
+            std::string error_message = job->get_error_message();
+            if (!error_message.empty()) {
+                std::cerr << error_message << std::endl;
+            }
+            // A history file is truncated by the next run written to it, so only runs kept in
+            // memory are cached.
+            else if (job->get_method() == IntegrationMethod::RK4
+                     && !dynamic_cast<FileFrameSink*>(&job->get_system()->get_frame_sink())) {
+                trajectory_cache.add(job->get_system(), job->get_integration_step(), job->get_time_step());
+            }
+            // The queue drops frames when it is full, make sure the last one is shown.
+            FrameSink& frame_sink = system->get_frame_sink();
+            int last = frame_sink.get_frame_count() - 1;
+            if (job->get_system() == system && !animating && last >= 0 && last != shown_frame && frame_sink.has_frame(last)) {
+                update_texture(texture, system.get(), last);
+                shown_frame = last;
+                show_time = frame_sink.get_frame_time(last);
+            }
+            job.reset();
+        }
+        cancelled_jobs.erase(std::remove_if(cancelled_jobs.begin(), cancelled_jobs.end(),
+                                            [](const std::unique_ptr<SimulationJob>& cancelled_job) {
+                                                return cancelled_job->is_finished();
+                                            }),
+                             cancelled_jobs.end());
+
+        if (animating) {
+            // Plays the computed frames at any frame rate and starts over after the last one.
+            FrameSink& frame_sink = system->get_frame_sink();
+            int frame_count = frame_sink.get_frame_count();
+            float computed_time = frame_count > 0 ? frame_sink.get_frame_time(frame_count - 1) : 0;
+            show_time += io.DeltaTime * animation_speed;
+            if (show_time > computed_time) {
+                show_time = 0;
+            }
+            shown_frame = update_texture_at_time(texture, system.get(), show_time, system_settings.time_step, shown_frame);
+        }
+
         if (ImGui::BeginMainMenuBar()) {
             if (ImGui::BeginMenu("File")) {
                 if (ImGui::MenuItem("Save image")) {
-                    save_image(texture, &system, show_time);
+                    save_image(texture, system.get(), show_time);
                 }
                 if (ImGui::MenuItem("Reset image")) {
-                    glDeleteTextures(1, &texture);
-                    system = PendulumSystem(size_x, size_y, bounds, 1.0, 1.0, 1.0, 1.0);
-                    calculate(&system, max_time, integration_step, time_step);
-                    std::cout << "Here in 1" << std::endl;
-                    texture = create_texture(&system);
-                    std::cout << std::round(show_time/time_step) << std::endl;
-                    update_texture(texture, &system, int(std::round(show_time/time_step)));
-                    std::cout << "Here in 3" << std::endl;
+                    IntegrationMethod method = adaptive_step ? IntegrationMethod::DormandPrince : IntegrationMethod::RK4;
+                    RunSettings settings = {size_x, size_y, bounds, integration_step, time_step, history_file, quantize_history,
+                                            method, absolute_tolerance, relative_tolerance, flip_time_mode, point_symmetry};
+                    FrameSink& frame_sink = system->get_frame_sink();
+                    int last = frame_sink.get_frame_count() - 1;
+                    // When only the maximum time grew (or the previous run was cancelled), the run
+                    // continues from its last frame and extends the history.
+                    bool continuing = settings == system_settings && last >= 0 && frame_sink.has_frame(last)
+                                      && frame_sink.is_lossless() && max_time > frame_sink.get_frame_time(last);
+
+                    if (job) {
+                        job->cancel();
+                        cancelled_jobs.push_back(std::move(job));
+                    }
+                    if (continuing) {
+                        // The cancelled jobs of this system have to stop before its state is reset.
+                        cancelled_jobs.erase(std::remove_if(cancelled_jobs.begin(), cancelled_jobs.end(),
+                                                            [&](const std::unique_ptr<SimulationJob>& cancelled_job) {
+                                                                return cancelled_job->get_system() == system;
+                                                            }),
+                                             cancelled_jobs.end());
+                        system->restore_state(last);
+                        job = std::make_unique<SimulationJob>(system, max_time, integration_step, time_step, nullptr,
+                                                              method, absolute_tolerance, relative_tolerance);
+                        run_max_time = max_time;
+                    }
+                    else {
+                        auto new_system = std::make_shared<PendulumSystem>(size_x, size_y, bounds, 1.0, 1.0, 1.0, 1.0);
+                        new_system->set_flip_time_mode(flip_time_mode);
+                        new_system->set_point_symmetry(point_symmetry);
+                        if (history_file[0] != '\0') {
+                            // A cancelled job may still write to the same file, wait until it stops.
+                            cancelled_jobs.clear();
+                            new_system->set_frame_sink(std::make_shared<FileFrameSink>(
+                                history_file, new_system->get_history_header(time_step, integration_step)));
+                        }
+                        else if (quantize_history) {
+                            // Rendering only needs the angles, so the velocities are not kept.
+                            new_system->set_frame_sink(std::make_shared<QuantizedFrameSink>(false));
+                        }
+                        job = std::make_unique<SimulationJob>(new_system, max_time, integration_step, time_step, &trajectory_cache,
+                                                              method, absolute_tolerance, relative_tolerance);
+
+                        system = new_system;
+                        system_settings = settings;
+                        run_max_time = max_time;
+                        zoom = 1;
+                        view_centre = ImVec2(0.5f, 0.5f);
+                        glDeleteTextures(1, &texture);
+                        texture = create_texture(system.get());
+                        shown_frame = -1;
+                        show_time = 0;
+                    }
+                }
+                if (ImGui::MenuItem("Cancel computation", nullptr, false, job != nullptr)) {
+                    job->cancel();
+                    cancelled_jobs.push_back(std::move(job));
+                }
+                if (ImGui::MenuItem("Open history", nullptr, false, history_file[0] != '\0')) {
+                    try {
+                        auto history = std::make_shared<FileFrameSink>(history_file);
+                        system = std::make_shared<PendulumSystem>(history);
+                        const HistoryHeader& header = history->get_header();
+                        size_x = header.size_x;
+                        size_y = header.size_y;
+                        bounds = header.bounds;
+                        time_step = header.time_step;
+                        integration_step = header.integration_step;
+                        max_time = system->get_time();
+                        run_max_time = max_time;
+                        show_time = 0;
+                        zoom = 1;
+                        view_centre = ImVec2(0.5f, 0.5f);
+                        // The method is not recorded, a continued history is integrated with RK4.
+                        // The controls match the loaded run, so that Reset continues it instead of
+                        // overwriting its file with a new run.
+                        adaptive_step = false;
+                        flip_time_mode = false;
+                        quantize_history = false;
+                        point_symmetry = false;
+                        system_settings = {size_x, size_y, bounds, integration_step, time_step, history_file, quantize_history,
+                                           IntegrationMethod::RK4, absolute_tolerance, relative_tolerance, flip_time_mode,
+                                           point_symmetry};
+
+                        glDeleteTextures(1, &texture);
+                        texture = create_texture(system.get());
+                        update_texture(texture, system.get(), 0);
+                        shown_frame = 0;
+                    }
+                    catch (const std::exception& exception) {
+                        std::cerr << exception.what() << std::endl;
+                    }
                 }
                 ImGui::EndMenu();
             }
@@ -207,17 +453,46 @@ int main() {
                 ImGui::InputInt("Size in y direction", &size_y);
                 ImGui::InputFloat("Maximum time", &max_time);
                 ImGui::InputDouble("Integration step", &integration_step);
+                // Times between the frames are interpolated, so longer intervals save memory.
+                ImGui::InputDouble("Frame interval", &time_step);
+                ImGui::InputText("History file", history_file, sizeof(history_file));
+                ImGui::Checkbox("Quantize recorded angles", &quantize_history);
+                ImGui::Checkbox("First flip time", &flip_time_mode);
+                ImGui::Checkbox("Mirror point symmetric pendulums", &point_symmetry);
+                ImGui::Checkbox("Adaptive step (Dormand-Prince)", &adaptive_step);
+                if (adaptive_step) {
+                    ImGui::InputDouble("Absolute tolerance", &absolute_tolerance, 0, 0, "%.1e");
+                    ImGui::InputDouble("Relative tolerance", &relative_tolerance, 0, 0, "%.1e");
+                }
                 ImGui::EndMenu();
             }
             if (ImGui::BeginMenu("View")) {
-                if (ImGui::SliderFloat("Time", &show_time, 0, max_time)) {
-                    update_texture(texture, &system, std::round(show_time/time_step));
+                // The slider covers the frames computed so far, also while a job is running.
+                FrameSink& frame_sink = system->get_frame_sink();
+                int frame_count = frame_sink.get_frame_count();
+                float computed_time = frame_count > 0 ? frame_sink.get_frame_time(frame_count - 1) : 0;
+                if (ImGui::SliderFloat("Time", &show_time, 0, computed_time)) {
+                    shown_frame = update_texture_at_time(texture, system.get(), show_time, system_settings.time_step, shown_frame);
                 }
-                if (ImGui::MenuItem("Animation")) {
-                    
+                ImGui::MenuItem("Animation", nullptr, &animating);
+                ImGui::SliderFloat("Animation speed", &animation_speed, 0.1f, 10.0f);
+                if (ImGui::MenuItem("Reset zoom")) {
+                    zoom = 1;
+                    view_centre = ImVec2(0.5f, 0.5f);
                 }
                 ImGui::EndMenu();
             }
+            if (job) {
+                int remaining_time = static_cast<int>(job->get_remaining_time());
+                ImGui::ProgressBar(job->get_progress(), ImVec2(200, 0));
+                ImGui::Text("Time remaining: %dh %dm %ds", remaining_time / 3600, (remaining_time % 3600) / 60, remaining_time % 60);
+                if (job->get_reused_count() > 0) {
+                    ImGui::Text("Reused %d of %d pendulums", job->get_reused_count(), job->get_system()->get_pendulum_count());
+                }
+            }
+            if (zoom > 1) {
+                ImGui::Text("Zoom %.0fx%s", zoom, tile_pyramid.is_busy() ? ", refining" : "");
+            }
             ImGui::EndMainMenuBar();
         }
 
@@ -228,7 +503,7 @@ int main() {
 
         ImVec2 avail = ImGui::GetContentRegionAvail();
         float windowAspect = avail.x / avail.y;
-        float imageAspect  = (float)system.get_size()[0] / (float)system.get_size()[1];
+        float imageAspect  = (float)system->get_size()[0] / (float)system->get_size()[1];
 
         ImVec2 imageSize;
         if (windowAspect > imageAspect) {
@@ -243,7 +518,109 @@ int main() {
         ImGui::SetCursorPosX(cursorPos.x + (avail.x - imageSize.x) * 0.5f);
         ImGui::SetCursorPosY(cursorPos.y + (avail.y - imageSize.y) * 0.5f);
 
-        ImGui::Image((void*)(intptr_t)texture, imageSize);
+        // Fraction of the image which is visible in each direction.
+        float visible = 1 / zoom;
+        ImVec2 image_min = ImGui::GetCursorScreenPos();
+        ImVec2 image_max(image_min.x + imageSize.x, image_min.y + imageSize.y);
+        ImVec2 uv0(view_centre.x - visible / 2, view_centre.y - visible / 2);
+        ImVec2 uv1(view_centre.x + visible / 2, view_centre.y + visible / 2);
+        ImGui::Image((void*)(intptr_t)texture, imageSize, uv0, uv1);
+
+        // The wheel zooms about the point under the mouse, dragging pans the view.
+        if (ImGui::IsItemHovered()) {
+            ImVec2 mouse = ImGui::GetMousePos();
+            ImVec2 fraction((mouse.x - image_min.x) / imageSize.x, (mouse.y - image_min.y) / imageSize.y);
+            if (io.MouseWheel != 0) {
+                ImVec2 point(uv0.x + fraction.x * visible, uv0.y + fraction.y * visible);
+                zoom = std::clamp(zoom * std::pow(1.25f, io.MouseWheel), 1.0f, 65536.0f);
+                visible = 1 / zoom;
+                view_centre = ImVec2(point.x - (fraction.x - 0.5f) * visible, point.y - (fraction.y - 0.5f) * visible);
+            }
+            if (ImGui::IsMouseDown(ImGuiMouseButton_Left)) {
+                view_centre.x -= io.MouseDelta.x / imageSize.x * visible;
+                view_centre.y -= io.MouseDelta.y / imageSize.y * visible;
+            }
+        }
+        view_centre.x = std::clamp(view_centre.x, visible / 2, 1 - visible / 2);
+        view_centre.y = std::clamp(view_centre.y, visible / 2, 1 - visible / 2);
+
+        // Tiles of the view are only shown with the last frame of a finished run.
+        TileSettings tile_settings = {system_settings.size_x, system_settings.size_y, system_settings.bounds,
+                                      system->get_parameters().mass_1, system->get_parameters().mass_2,
+                                      system->get_parameters().length_1, system->get_parameters().length_2,
+                                      system_settings.integration_step, system_settings.time_step, run_max_time,
+                                      system_settings.method, system_settings.absolute_tolerance,
+                                      system_settings.relative_tolerance, system_settings.flip_time_mode,
+                                      system->get_instruction_set()};
+        tile_pyramid.set_settings(tile_settings);
+        if (tile_pyramid.get_generation() != tile_generation) {
+            delete_tile_textures(tile_textures);
+            tile_generation = tile_pyramid.get_generation();
+        }
+        TileKey tile_key;
+        std::vector<unsigned char> tile_pixels;
+        while (tile_pyramid.pop_finished_tile(tile_key, tile_pixels)) {
+            tile_textures[tile_key] = {create_tile_texture(tile_pyramid.get_tile_size(), tile_pixels), frame};
+        }
+        std::string tile_error = tile_pyramid.take_error_message();
+        if (!tile_error.empty()) {
+            std::cerr << tile_error << std::endl;
+        }
+
+        FrameSink& shown_sink = system->get_frame_sink();
+        int shown_count = shown_sink.get_frame_count();
+        bool at_end = shown_count > 0 && show_time >= (float) shown_sink.get_frame_time(shown_count - 1);
+        std::vector<TileKey> missing_tiles;
+        if (zoom > 1 && !job && !animating && at_end) {
+            int tile_size = tile_pyramid.get_tile_size();
+            // The finest level has at least one pixel per screen pixel.
+            int level = std::ceil(std::log2(std::max(imageSize.x * zoom / system_settings.size_x,
+                                                     imageSize.y * zoom / system_settings.size_y)));
+            level = std::clamp(level, 1, 24);
+
+            ImDrawList* draw_list = ImGui::GetWindowDrawList();
+            draw_list->PushClipRect(image_min, image_max, true);
+            // Coarser levels first, so that they show where the finer tiles are still missing.
+            for (int l = 1; l <= level; l++) {
+                double width = std::ldexp((double) system_settings.size_x, l);
+                double height = std::ldexp((double) system_settings.size_y, l);
+                int x_first = std::max(0, (int) std::floor(uv0.x * width / tile_size));
+                int x_last = std::min((int) std::ceil(width / tile_size) - 1, (int) std::floor(uv1.x * width / tile_size));
+                int y_first = std::max(0, (int) std::floor(uv0.y * height / tile_size));
+                int y_last = std::min((int) std::ceil(height / tile_size) - 1, (int) std::floor(uv1.y * height / tile_size));
+                for (int y = y_first; y <= y_last; y++) {
+                    for (int x = x_first; x <= x_last; x++) {
+                        auto tile = tile_textures.find({l, x, y});
+                        if (tile == tile_textures.end()) {
+                            if (l == level) {
+                                missing_tiles.push_back({l, x, y});
+                            }
+                            continue;
+                        }
+                        ImVec2 tile_min(image_min.x + (x * tile_size / width - uv0.x) / visible * imageSize.x,
+                                        image_min.y + (y * tile_size / height - uv0.y) / visible * imageSize.y);
+                        ImVec2 tile_max(image_min.x + ((x + 1) * tile_size / width - uv0.x) / visible * imageSize.x,
+                                        image_min.y + ((y + 1) * tile_size / height - uv0.y) / visible * imageSize.y);
+                        draw_list->AddImage((void*)(intptr_t)tile->second.texture, tile_min, tile_max);
+                        tile->second.last_drawn = frame;
+                    }
+                }
+            }
+            draw_list->PopClipRect();
+
+            // The tiles closest to the centre of the view come first.
+            double width = std::ldexp((double) system_settings.size_x, level) / tile_size;
+            double height = std::ldexp((double) system_settings.size_y, level) / tile_size;
+            auto distance = [&](const TileKey& key) {
+                return std::hypot(key.x + 0.5 - view_centre.x * width, key.y + 0.5 - view_centre.y * height);
+            };
+            std::sort(missing_tiles.begin(), missing_tiles.end(), [&](const TileKey& a, const TileKey& b) {
+                return distance(a) < distance(b);
+            });
+        }
+        tile_pyramid.request_tiles(missing_tiles);
+        evict_tile_textures(tile_textures, tile_pyramid, max_tile_textures, frame);
+        frame++;
         ImGui::End();
 
         ImGui::Render();
@@ -259,6 +636,7 @@ int main() {
     }
 
     glDeleteTextures(1, &texture);
+    delete_tile_textures(tile_textures);
 
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();